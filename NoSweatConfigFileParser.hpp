@@ -27,458 +27,4507 @@ SOFTWARE.
 
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <set>
+#include <locale>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define NOSWEAT_HAVE_MMAP
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NOSWEAT_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace NoSweat {
+    class NoSweatConfigFileParser;
+    class SharedConfigRegion;
+
+    /// Non-owning reference to a range of characters, comparable to C++17's
+    /// std::string_view. Used to tokenize the configuration without copying.
+    class StringRef {
+        public:
+            StringRef() : data_(nullptr), size_(0) {}
+            StringRef(const char* data, std::size_t size) : data_(data), size_(size) {}
+            StringRef(const char* str) : data_(str), size_(std::strlen(str)) {}
+            StringRef(const std::string& str) : data_(str.data()), size_(str.size()) {}
+
+            const char* data() const { return data_; }
+            std::size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+            const char* begin() const { return data_; }
+            const char* end() const { return data_ + size_; }
+            char operator[](std::size_t index) const { return data_[index]; }
+            std::string str() const { return std::string(data_, size_); }
+            operator std::string() const { return str(); }
+
+            inline StringRef substr(std::size_t pos, std::size_t count = std::string::npos) const;
+            inline std::size_t find_first_of(StringRef chars, std::size_t pos = 0) const;
+            inline bool starts_with(StringRef prefix) const;
+            // Copy with leading and trailing whitespace removed.
+            inline StringRef trimmed() const;
+
+        private:
+            const char* data_;
+            std::size_t size_;
+    };
+
+    inline bool operator==(StringRef lhs, StringRef rhs);
+    inline bool operator!=(StringRef lhs, StringRef rhs);
+    inline bool operator<(StringRef lhs, StringRef rhs);
+    inline std::ostream& operator<<(std::ostream& stream, StringRef str);
+
+    /// Non-owning reference to contiguous elements, comparable to C++20's
+    /// std::span. Array values are returned as ArrayRefs without copying.
+    template<typename T>
+    class ArrayRef {
+        public:
+            ArrayRef() : data_(nullptr), size_(0) {}
+            ArrayRef(const T* data, std::size_t size) : data_(data), size_(size) {}
+
+            const T* data() const { return data_; }
+            std::size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+            const T* begin() const { return data_; }
+            const T* end() const { return data_ + size_; }
+            const T& operator[](std::size_t index) const { return data_[index]; }
+            std::vector<T> vector() const { return std::vector<T>(begin(), end()); }
+            operator std::vector<T>() const { return vector(); }
+
+        private:
+            const T* data_;
+            std::size_t size_;
+    };
+
+    /// Read-only view of a whole file. The file is memory-mapped where
+    /// possible and otherwise read into a buffer.
+    class MappedFile {
+        public:
+            inline explicit MappedFile(const std::string& path);
+            inline ~MappedFile();
+            bool is_open() const { return is_open_; }
+            const char* data() const { return data_; }
+            std::size_t size() const { return size_; }
+
+        private:
+            MappedFile(const MappedFile&);
+            MappedFile& operator=(const MappedFile&);
+            inline void read_into_buffer(const std::string& path);
+
+            const char* data_;
+            std::size_t size_;
+            bool is_open_;
+            bool is_mapped_;
+            std::vector<char> buffer_;
+    };
+
+    // Instruction sets the line scanner can use.
+    enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+    /// Splits a buffer into lines and finds the first assignment operator of
+    /// every line. Bitmasks of all newlines and assignment operators are
+    /// computed for whole 64 byte blocks, with AVX2 or SSE2 if available, and
+    /// then walked with bit operations instead of searching per character.
+    class LineScanner {
+        public:
+            inline LineScanner(const char* data, std::size_t size);
+            inline LineScanner(const char* data, std::size_t size, SimdLevel simd_level);
+            // Get the next (untrimmed) line and the index of its first
+            // assignment operator or std::string::npos. Return false at the
+            // end of the buffer.
+            inline bool next(StringRef& line, std::size_t& assignment_index);
+            // Same as next(), but a line with assignment operator ending with
+            // a comma is continued by the following lines without one, e.g.
+            // the elements of an array on several lines. Empty lines,
+            // comments and section headers end the statement.
+            inline bool next_statement(StringRef& statement, std::size_t& assignment_index);
+
+        private:
+            typedef void (*BlockMaskFunction)(const char* block, std::uint64_t& newlines, std::uint64_t& assignments);
+            inline void scan_block(std::size_t block_start);
+
+            const char* data_;
+            std::size_t size_;
+            // Start of the next line.
+            std::size_t position_;
+            // Start of the block the masks belong to.
+            std::size_t block_start_;
+            std::uint64_t newline_mask_;
+            std::uint64_t assignment_mask_;
+            BlockMaskFunction block_mask_function_;
+    };
+
+    // The best instruction set supported by the CPU, determined once.
+    inline SimdLevel detected_simd_level();
+
+    // The types a configuration value can have. Arrays are lists of
+    // numbers of the types before them, e.g. "float[]".
+    enum class ValueType {
+        Unknown, Integer, Float, String, Bool, Integer64, Double,
+        IntegerArray, FloatArray, Integer64Array, DoubleArray
+    };
+
+    /// Maps short words such as boolean literals and type keywords to small
+    /// values with a perfect hash: every literal has a slot of its own, so a
+    /// lookup hashes the word once and compares it with a single literal,
+    /// without allocating. A new hash seed (and, if needed, a larger table)
+    /// is searched whenever a literal is added.
+    class LiteralTable {
+        public:
+            static const std::size_t max_literal_size = 15;
+            inline LiteralTable(bool case_sensitive, std::initializer_list<std::pair<const char*, int>> literals);
+            // Add a literal or change its value. Return false if the literal
+            // is empty or longer than max_literal_size.
+            inline bool add(StringRef literal, int value);
+            // The value of the word or -1 if it is no literal.
+            inline int find(StringRef word) const;
+
+        private:
+            struct Slot {
+                char literal[max_literal_size];
+                std::uint8_t size;
+                int value;
+            };
+            char normalized(char c) const { return !case_sensitive_ && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+            inline std::size_t slot_index(StringRef word, std::uint32_t seed, std::size_t slot_count) const;
+            inline void rebuild();
+
+            bool case_sensitive_;
+            std::uint32_t seed_;
+            // All literals in the order they have been added.
+            std::vector<Slot> literals_;
+            std::vector<Slot> slots_;
+    };
+
+    // The type keywords every parser and ConfigStream starts with.
+    inline LiteralTable default_type_keywords();
+
+    // One tokenized configuration line. Key and value point into the parsed
+    // buffer. The type is Unknown for user configuration lines without type.
+    struct ConfigLine {
+        ValueType type;
+        StringRef key;
+        StringRef value;
+        // Name of the [section] the line is in, empty outside of sections.
+        StringRef section;
+    };
+
+    /// A single configuration value of any type. Strings of up to
+    /// inline_capacity characters are stored inside the value itself, longer
+    /// ones in a StringStorage.
+    struct ConfigValue {
+        static const std::size_t inline_capacity = 16;
+        union {
+            int integer;
+            float floating;
+            bool boolean;
+            std::int64_t integer64;
+            double floating64;
+            const char* external_string;
+            char inline_string[inline_capacity];
+            // Elements of arrays, never stored inline.
+            const void* external_array;
+        };
+        // The size of strings or the number of elements of arrays.
+        std::uint32_t string_size;
+
+        StringRef string() const {
+            return StringRef(string_size <= inline_capacity ? inline_string : external_string, string_size);
+        }
+        template<typename T>
+        ArrayRef<T> array() const { return ArrayRef<T>(static_cast<const T*>(external_array), string_size); }
+    };
+
+    /// Owns copies of keys and of strings that are too long to be stored
+    /// inline. The copies are packed one after the other into a few large
+    /// blocks, which grow geometrically, instead of allocating each string
+    /// separately. Strings are only freed all at once with the storage.
+    class StringStorage {
+        public:
+            static const std::size_t min_block_size = 4096;
+            static const std::size_t max_block_size = 1 << 20;
+            StringStorage() : next_(nullptr), available_(0), block_size_(min_block_size) {}
+            inline StringStorage(StringStorage&& other);
+            inline StringStorage& operator=(StringStorage&& other);
+            // Copy the string and return the copy.
+            inline const char* store(StringRef str);
+            // Store "section.key" and return the copy of the key in it.
+            inline const char* store_key(StringRef section, StringRef key);
+            // Set the value to a copy of the string.
+            inline void assign(ConfigValue& value, StringRef str);
+            // Uninitialized memory for the elements of an array, aligned for
+            // all element types.
+            inline char* allocate_array(std::size_t size);
+            // Set the array value to a copy of its elements.
+            inline void assign_array(ConfigValue& value, ValueType type);
+            // Make sure the next strings of the given total size fit into a
+            // single block.
+            inline void reserve(std::size_t size);
+            // Take ownership of strings copied elsewhere.
+            void adopt(std::unique_ptr<char[]> strings) { blocks_.push_back(std::move(strings)); }
+            inline void adopt(StringStorage&& other);
+
+        private:
+            StringStorage(const StringStorage&);
+            StringStorage& operator=(const StringStorage&);
+            inline char* allocate_block(std::size_t size);
+
+            std::vector<std::unique_ptr<char[]>> blocks_;
+            // Free part of the current block.
+            char* next_;
+            std::size_t available_;
+            // Size of the next block.
+            std::size_t block_size_;
+    };
+
+    // A configuration key with its type and default value. The user set
+    // values live in ValueSnapshots where they are found by the id. Keys of
+    // a [section] are stored as "section.key", so the section directly
+    // precedes the key.
+    struct ConfigEntry {
+        // The key without its section.
+        StringRef key;
+        ValueType type;
+        std::uint32_t id;
+        // Size of the section name, zero for keys outside of sections.
+        std::uint32_t section_size;
+        ConfigValue default_value;
+
+        StringRef section() const {
+            return section_size ? StringRef(key.data() - section_size - 1, section_size) : StringRef();
+        }
+        // "section.key", or the key for keys outside of sections.
+        StringRef qualified_key() const {
+            return section_size ? StringRef(key.data() - section_size - 1, section_size + 1 + key.size()) : key;
+        }
+    };
+
+    // The keys whose values have been changed by reading a configuration.
+    typedef std::vector<const ConfigEntry*> ChangeSet;
+
+    /// All configuration keys of all types in a single open addressing hash
+    /// table, so finding a key and its type takes a single probe sequence.
+    /// Entries never move once inserted and are numbered in insertion order.
+    /// Keys of sections are found by "section.key" and, unless another key
+    /// has the same name, by their key alone: the key outside of sections,
+    /// or else the first key of that name in any section.
+    class ValueStore {
+        public:
+            inline ValueStore();
+            // Copies all entries to storage owned by the new store.
+            inline ValueStore(const ValueStore& other);
+            ValueStore(ValueStore&& other) = default;
+            inline ValueStore& operator=(ValueStore other);
+            // The entry of the key or nullptr.
+            inline const ConfigEntry* find(StringRef key) const;
+            // The entry of "section.key", or of the key if section is empty.
+            inline const ConfigEntry* find(StringRef section, StringRef key, std::uint64_t hash) const;
+            // Add a key with the given default value. Return nullptr if the
+            // key already exists. String values are passed as default_string
+            // and copied, as are the elements of arrays.
+            inline const ConfigEntry* insert(StringRef key, ValueType type, const ConfigValue& default_value,
+                                             StringRef default_string = StringRef());
+            // Same as insert() for a key of a section, with the
+            // hash_key(section, key) computed beforehand.
+            inline const ConfigEntry* insert(StringRef section, StringRef key, std::uint64_t hash, ValueType type,
+                                             const ConfigValue& default_value, StringRef default_string);
+            // Same as insert(), but neither the key nor a string or array
+            // default value are copied, so both have to outlive the store.
+            // Keys of sections are passed as "section.key".
+            inline const ConfigEntry* insert_external(StringRef qualified_key, std::uint32_t section_size,
+                                                      ValueType type, const ConfigValue& default_value);
+            inline const ConfigEntry* insert_external(StringRef qualified_key, std::uint32_t section_size,
+                                                      std::uint64_t hash, ValueType type,
+                                                      const ConfigValue& default_value);
+            // True if a key is in the section or in one of its subsections.
+            inline bool has_section(StringRef section) const;
+            // Names of all sections with keys, sorted.
+            const std::set<std::string>& sections() const { return sections_; }
+            // The entries whose qualified keys start with prefix, sorted by
+            // qualified key. Not thread-safe.
+            inline std::vector<const ConfigEntry*> entries_with_prefix(StringRef prefix) const;
+            // Hint that the key with the given hash_key() will be looked up soon.
+            void prefetch(std::uint64_t hash) const {
+#if defined(__GNUC__) || defined(__clang__)
+                __builtin_prefetch(&slots_[hash & (slots_.size() - 1)]);
+#else
+                (void)hash;
+#endif
+            }
+            // Keep strings that keys and values inserted with insert_external() refer to.
+            void adopt_strings(std::unique_ptr<char[]> strings) { strings_.adopt(std::move(strings)); }
+            void adopt_strings(StringStorage&& strings) { strings_.adopt(std::move(strings)); }
+            // Make room for the given number of keys.
+            inline void reserve(std::size_t size);
+            const ConfigEntry& entry(std::size_t id) const { return entries_[id]; }
+            std::size_t size() const { return entries_.size(); }
+            const std::deque<ConfigEntry>& entries() const { return entries_; }
+
+        private:
+            // Empty slots have an entry index of zero, all others the index
+            // plus one. Slots finding keys of sections by their key alone
+            // have alias_bit set in addition.
+            struct Slot {
+                std::uint32_t hash;
+                std::uint32_t entry;
+            };
+            static const std::uint32_t alias_bit = 0x80000000u;
+            // The key a slot is found by.
+            StringRef slot_key(const Slot& slot) const {
+                const ConfigEntry& entry = entries_[(slot.entry & ~alias_bit) - 1];
+                return slot.entry & alias_bit ? entry.key : entry.qualified_key();
+            }
+            // Index of the slot holding "section.key" (or the key if section
+            // is empty) or of the empty slot it would be inserted in.
+            inline std::size_t find_slot(StringRef section, StringRef key, std::uint64_t hash) const;
+            // Add an entry for "section.key", or return nullptr if the key
+            // exists. The key of the entry has to be set to its final
+            // storage, directly after the section, by the caller.
+            inline ConfigEntry* add(StringRef section, StringRef key, std::uint64_t hash, ValueType type,
+                                    const ConfigValue& default_value);
+            // Find the key of a section entry by its key alone, unless another key has that name.
+            inline void add_alias(const ConfigEntry& entry);
+            inline void grow();
+            // Slot counts have to be powers of two.
+            inline void rehash(std::size_t slot_count);
+
+            std::deque<ConfigEntry> entries_;
+            std::vector<Slot> slots_;
+            std::size_t used_slots_;
+            StringStorage strings_;
+            std::set<std::string> sections_;
+            // Ids of all entries sorted by qualified key, updated on demand.
+            mutable std::vector<std::uint32_t> sorted_ids_;
+    };
+
+    /// The user set values of all keys, indexed by entry id. A snapshot is
+    /// never modified after it has been published, so it can be read by any
+    /// number of threads without locks.
+    class ValueSnapshot {
+        public:
+            // Start with the default values of all keys of the store.
+            inline explicit ValueSnapshot(const ValueStore& store);
+            // Start with the values of another snapshot, with default values
+            // for all keys added to the store since.
+            inline ValueSnapshot(const ValueSnapshot& other, const ValueStore& store);
+            const ConfigValue& operator[](std::size_t id) const { return values_[id]; }
+            std::size_t size() const { return values_.size(); }
+            void set(const ConfigEntry& entry, const ConfigValue& value) { values_[entry.id] = value; }
+            // A string equal to the default value shares its storage.
+            inline void set_string(const ConfigEntry& entry, StringRef str);
+            // Same for arrays, whose elements are copied otherwise.
+            inline void set_array(const ConfigEntry& entry, const ConfigValue& value);
+
+        private:
+            ValueSnapshot(const ValueSnapshot&);
+            ValueSnapshot& operator=(const ValueSnapshot&);
+
+            std::vector<ConfigValue> values_;
+            StringStorage strings_;
+    };
+
+    // The phases parsing time is attributed to: opening and reading files,
+    // splitting the lines into type, key and value, converting the values
+    // and inserting them.
+    enum class Phase { Io, Tokenize, Convert, Insert };
+
+    // Number of reads of a key, or of requests for a key that does not
+    // exist with the requested type.
+    struct KeyCount {
+        std::string key;
+        ValueType type;
+        std::uint64_t count;
+    };
+
+    // Everything the instrumentation has recorded so far.
+    struct InstrumentationStats {
+        // False if compiled without NOSWEAT_INSTRUMENTATION. Everything else
+        // is empty then.
+        bool enabled;
+        // Keys read through get_*(), handles, views or schemas, most read first.
+        std::vector<KeyCount> reads;
+        // Keys requested but not defined with the requested type, most requested first.
+        std::vector<KeyCount> misses;
+        // Nanoseconds spent in each Phase, summed over all parsing threads.
+        std::uint64_t phase_nanoseconds[4];
+    };
+
+#ifdef NOSWEAT_INSTRUMENTATION
+    /// Counts reads per key id with relaxed atomics and records misses and
+    /// phase times. The counters are allocated in blocks on first use and
+    /// never move, so counting does not need to synchronize with adding keys.
+    class Instrumentation {
+        public:
+            static const std::uint32_t block_size = 1 << 16;
+            static const std::uint32_t max_blocks = 1 << 12;
+
+            inline Instrumentation();
+            inline ~Instrumentation();
+            inline void record_read(std::uint32_t id) const;
+            inline void record_miss(StringRef key, ValueType type) const;
+            void add_phase_time(Phase phase, std::uint64_t nanoseconds) {
+                phase_nanoseconds_[static_cast<int>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+            }
+            // The number of reads of the key with the given id.
+            inline std::uint64_t reads(std::uint32_t id) const;
+            // Fills in misses and phase times.
+            inline void stats(InstrumentationStats& stats) const;
+
+        private:
+            Instrumentation(const Instrumentation&);
+            Instrumentation& operator=(const Instrumentation&);
+
+            mutable std::atomic<std::atomic<std::uint64_t>*> read_counts_[max_blocks];
+            mutable std::mutex misses_mutex_;
+            mutable std::map<std::pair<std::string, ValueType>, std::uint64_t> misses_;
+            std::atomic<std::uint64_t> phase_nanoseconds_[4];
+    };
+
+    /// Attributes the time since the previous lap to a phase. The times are
+    /// added to the Instrumentation once, when the clock is destroyed, so
+    /// threads parsing chunks do not contend.
+    class PhaseClock {
+        public:
+            explicit PhaseClock(Instrumentation& instrumentation)
+            : instrumentation_(instrumentation), last_lap_(std::chrono::steady_clock::now()), nanoseconds_() {}
+            ~PhaseClock() {
+                for (int phase = 0; phase < 4; phase++)
+                    instrumentation_.add_phase_time(static_cast<Phase>(phase), nanoseconds_[phase]);
+            }
+            void lap(Phase phase) {
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                nanoseconds_[static_cast<int>(phase)] +=
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_lap_).count();
+                last_lap_ = now;
+            }
+
+        private:
+            Instrumentation& instrumentation_;
+            std::chrono::steady_clock::time_point last_lap_;
+            std::uint64_t nanoseconds_[4];
+    };
+#else
+    // Without NOSWEAT_INSTRUMENTATION all recording compiles to nothing.
+    class Instrumentation {
+        public:
+            void record_read(std::uint32_t) const {}
+            void record_miss(StringRef, ValueType) const {}
+            std::uint64_t reads(std::uint32_t) const { return 0; }
+            void stats(InstrumentationStats&) const {}
+    };
+
+    class PhaseClock {
+        public:
+            explicit PhaseClock(Instrumentation&) {}
+            void lap(Phase) {}
+    };
+#endif
+
+    /// Holds the current ValueSnapshot and replaces it with an atomic pointer
+    /// swap, RCU style. Readers are wait-free: they register in one of two
+    /// epoch counters, load the pointer and deregister, never locking or
+    /// retrying. A replaced snapshot is deleted once all readers that could
+    /// still see it are gone. The counters are striped over cache lines so
+    /// readers on different threads do not contend.
+    class SnapshotPointer {
+        public:
+            static const unsigned stripes = 16;
+
+            // Pins the current snapshot while it exists.
+            class ReadGuard {
+                public:
+                    inline explicit ReadGuard(const SnapshotPointer& pointer);
+                    inline ~ReadGuard();
+                    const ValueSnapshot& operator*() const { return *snapshot_; }
+                    const ValueSnapshot* operator->() const { return snapshot_; }
+
+                private:
+                    ReadGuard(const ReadGuard&);
+                    ReadGuard& operator=(const ReadGuard&);
+
+                    std::atomic<std::size_t>* reader_count_;
+                    const ValueSnapshot* snapshot_;
+            };
+
+            // Takes ownership of the initial snapshot.
+            inline explicit SnapshotPointer(const ValueSnapshot* snapshot);
+            inline ~SnapshotPointer();
+            // Writers need to hold this mutex.
+            std::mutex& write_mutex() { return write_mutex_; }
+            // The current snapshot. Only safe for writers.
+            const ValueSnapshot& current() const { return *snapshot_.load(); }
+            // Replace the current snapshot, taking ownership of the new one,
+            // and delete the old one once no reader uses it any more.
+            void publish(const ValueSnapshot* snapshot) { exchange(snapshot); }
+            // Same as publish(), but return the old snapshot instead of deleting it.
+            inline std::unique_ptr<const ValueSnapshot> exchange(const ValueSnapshot* snapshot);
+            // All reads go through the pointer, so they are recorded here.
+            Instrumentation& instrumentation() const { return instrumentation_; }
+
+        private:
+            SnapshotPointer(const SnapshotPointer&);
+            SnapshotPointer& operator=(const SnapshotPointer&);
+            // Wait until no reader is registered in the counters of the epoch.
+            inline void wait_for_readers(unsigned epoch) const;
+
+            // Padded so that no two counters share a cache line, whatever the alignment.
+            struct ReaderCounter {
+                std::atomic<std::size_t> count;
+                char padding[128 - sizeof(std::atomic<std::size_t>)];
+            };
+            mutable ReaderCounter readers_[2][stripes];
+            std::atomic<unsigned> epoch_;
+            std::atomic<const ValueSnapshot*> snapshot_;
+            std::mutex write_mutex_;
+            mutable Instrumentation instrumentation_;
+    };
+
+    // Map C++ types to value types. Values are returned as value_type, or as
+    // result_type where the returned value does not need to outlive the
+    // snapshot it has been read from.
+    template<typename T>
+    struct ValueTraits;
+    template<>
+    struct ValueTraits<int> {
+        typedef int value_type;
+        typedef int result_type;
+        static constexpr ValueType type = ValueType::Integer;
+        static int get(const ConfigValue& value) { return value.integer; }
+    };
+    template<>
+    struct ValueTraits<float> {
+        typedef float value_type;
+        typedef float result_type;
+        static constexpr ValueType type = ValueType::Float;
+        static float get(const ConfigValue& value) { return value.floating; }
+    };
+    template<>
+    struct ValueTraits<std::string> {
+        typedef std::string value_type;
+        typedef StringRef result_type;
+        static constexpr ValueType type = ValueType::String;
+        static StringRef get(const ConfigValue& value) { return value.string(); }
+    };
+    template<>
+    struct ValueTraits<bool> {
+        typedef bool value_type;
+        typedef bool result_type;
+        static constexpr ValueType type = ValueType::Bool;
+        static bool get(const ConfigValue& value) { return value.boolean; }
+    };
+    template<>
+    struct ValueTraits<std::int64_t> {
+        typedef std::int64_t value_type;
+        typedef std::int64_t result_type;
+        static constexpr ValueType type = ValueType::Integer64;
+        static std::int64_t get(const ConfigValue& value) { return value.integer64; }
+    };
+    template<>
+    struct ValueTraits<double> {
+        typedef double value_type;
+        typedef double result_type;
+        static constexpr ValueType type = ValueType::Double;
+        static double get(const ConfigValue& value) { return value.floating64; }
+    };
+    // Arrays are returned as std::vector, or as ArrayRef into the snapshot.
+    template<typename T, ValueType Type>
+    struct ArrayValueTraits {
+        typedef std::vector<T> value_type;
+        typedef ArrayRef<T> result_type;
+        static constexpr ValueType type = Type;
+        static ArrayRef<T> get(const ConfigValue& value) { return value.array<T>(); }
+    };
+    template<>
+    struct ValueTraits<std::vector<int>> : ArrayValueTraits<int, ValueType::IntegerArray> {};
+    template<>
+    struct ValueTraits<std::vector<float>> : ArrayValueTraits<float, ValueType::FloatArray> {};
+    template<>
+    struct ValueTraits<std::vector<std::int64_t>> : ArrayValueTraits<std::int64_t, ValueType::Integer64Array> {};
+    template<>
+    struct ValueTraits<std::vector<double>> : ArrayValueTraits<double, ValueType::DoubleArray> {};
+    // Arrays are not supported as members of schemas.
+    template<typename T>
+    struct IsSchemaMember : std::true_type {};
+    template<typename T>
+    struct IsSchemaMember<std::vector<T>> : std::false_type {};
+
+    /// A key interned by a parser. Every distinct key is stored once and
+    /// numbered in the order the keys have been added, so an id is a small
+    /// integer and reading a value by id is an array access. Ids stay valid
+    /// for the lifetime of the parser and are the same in its copies. Unlike
+    /// a Handle, an id does not carry a type.
+    class KeyId {
+        public:
+            static const std::uint32_t invalid = UINT32_MAX;
+            KeyId() : value_(invalid) {}
+            explicit KeyId(std::uint32_t value) : value_(value) {}
+            // False for keys that did not exist upon interning.
+            bool is_valid() const { return value_ != invalid; }
+            std::uint32_t value() const { return value_; }
+
+        private:
+            std::uint32_t value_;
+    };
+
+    inline bool operator==(KeyId lhs, KeyId rhs) { return lhs.value() == rhs.value(); }
+    inline bool operator!=(KeyId lhs, KeyId rhs) { return lhs.value() != rhs.value(); }
+
+    /// A key resolved once into a typed reference to its value. Reading it
+    /// afterwards does neither copy nor compare nor hash the key.
+    template<typename T>
+    class Handle {
+        public:
+            Handle() : snapshots_(nullptr), id_(0) {}
+            // True if the key existed with the requested type upon resolution.
+            bool is_valid() const { return snapshots_ != nullptr; }
+            typename ValueTraits<T>::value_type get() const {
+                if (!snapshots_)
+                    return typename ValueTraits<T>::value_type();
+                snapshots_->instrumentation().record_read(id_);
+                SnapshotPointer::ReadGuard guard{*snapshots_};
+                return ValueTraits<T>::get((*guard)[id_]);
+            }
+
+        private:
+            friend class NoSweatConfigFileParser;
+            friend class ConfigView;
+            Handle(const SnapshotPointer* snapshots, std::uint32_t id) : snapshots_(snapshots), id_(id) {}
+            // The snapshots of the parser and the id of the entry.
+            const SnapshotPointer* snapshots_;
+            std::uint32_t id_;
+    };
+
+    /// Calls the functions subscribed to keys or key prefixes for all changed
+    /// values of matching keys.
+    class ChangeNotifier {
+        public:
+            typedef std::function<void(const ConfigEntry& entry, const ConfigValue& old_value,
+                                       const ConfigValue& new_value)> Callback;
+
+            ChangeNotifier() : next_id_(0) {}
+            // Subscribe to changes of a key, or of all keys starting with it
+            // if is_prefix is set, of the given type. Return an id for unsubscribe().
+            inline std::size_t subscribe(StringRef key, bool is_prefix, ValueType type, Callback callback);
+            inline void unsubscribe(std::size_t id);
+            // Call all matching functions, one after the other.
+            inline void notify(const ChangeSet& changes, const ValueSnapshot& old_values,
+                               const ValueSnapshot& new_values) const;
+
+        private:
+            struct Subscription {
+                std::size_t id;
+                std::string key;
+                bool is_prefix;
+                ValueType type;
+                Callback callback;
+            };
+
+            // Not held while calling the functions, so they may (un)subscribe.
+            mutable std::mutex mutex_;
+            std::vector<Subscription> subscriptions_;
+            std::size_t next_id_;
+    };
+
+    /// A consistent view of all values at one point in time. Strings read
+    /// through it are not copied and stay valid as long as the view exists.
+    /// Views should be short-lived, because reloads wait for them to end
+    /// before the values they show can be freed.
+    class ConfigView {
+        public:
+            inline explicit ConfigView(const NoSweatConfigFileParser& parser);
+            // Handles of other parsers return the default value of the type.
+            template<typename T>
+            typename ValueTraits<T>::result_type get(const Handle<T>& handle) const {
+                if (handle.snapshots_ != snapshots_)
+                    return typename ValueTraits<T>::result_type();
+                snapshots_->instrumentation().record_read(handle.id_);
+                return ValueTraits<T>::get((*guard_)[handle.id_]);
+            }
+
+        private:
+            const SnapshotPointer* snapshots_;
+            SnapshotPointer::ReadGuard guard_;
+    };
+
+    // A line yielded by ConfigStream. Key and value point into the stream's
+    // buffer and stay valid until the next line is read. The type is
+    // Unknown for lines without type keyword.
+    struct ConfigEvent {
+        ValueType type;
+        // The section of the line, empty before the first header.
+        StringRef section;
+        StringRef key;
+        StringRef value;
+        // Starting at 1, counting all lines. The first line of a continued array.
+        std::size_t line_number;
+    };
+
+    /// Pull parser for consumers that only look for a few keys or forward
+    /// the lines elsewhere. Lines of the form "[type] key = value" are
+    /// yielded one at a time as the input is read; values are neither
+    /// converted nor stored and comments and lines without assignment are
+    /// skipped. An array continued on the following lines is yielded as one
+    /// line. The input is read in blocks into a buffer of fixed size, which
+    /// only grows for a line longer than the buffer, so memory use does not
+    /// depend on the size of the input.
+    class ConfigStream {
+        public:
+            static const std::size_t default_buffer_size = 1 << 16;
+#ifdef NOSWEAT_HAVE_MMAP
+            // Read from a file descriptor, e.g. of a pipe. It is not closed.
+            inline explicit ConfigStream(int fd, std::size_t buffer_size = default_buffer_size);
+#endif
+            inline explicit ConfigStream(std::istream& stream, std::size_t buffer_size = default_buffer_size);
+            // The buffer is not copied and has to outlive the stream.
+            inline ConfigStream(const char* data, std::size_t size);
+            // Recognize the type keywords added to the parser with
+            // add_type_keyword() as well.
+            inline void use_type_keywords(const NoSweatConfigFileParser& parser);
+            // Get the next line. Return false at the end of the input or if
+            // reading fails. To stop early, just stop calling next().
+            inline bool next(ConfigEvent& event);
+            bool has_error() const { return has_error_; }
+
+        private:
+            ConfigStream(const ConfigStream&);
+            ConfigStream& operator=(const ConfigStream&);
+            // Move the unread input to the front of the buffer and append
+            // the next block. Sets at_end_ if there is no more input.
+            inline void fill();
+            // Find the line starting offset bytes after begin_, reading more
+            // input until it is complete. Return false if there is none.
+            inline bool find_line(std::size_t offset, std::size_t& size, std::size_t& next_offset);
+
+            LiteralTable type_keywords_;
+            int fd_;
+            std::istream* stream_;
+            std::vector<char> buffer_;
+            // Either the buffer or the caller's data.
+            const char* data_;
+            // Unread part of data_.
+            std::size_t begin_;
+            std::size_t end_;
+            std::size_t line_number_;
+            // Copied, as the header line may no longer be buffered.
+            std::string section_;
+            bool at_end_;
+            bool has_error_;
+    };
+
+    // Output formats of NoSweatConfigFileParser::emit_configuration(): the
+    // syntax of the default configuration file, or a JSON object.
+    enum class EmitFormat { Config, Json };
+
     class NoSweatConfigFileParser {
         public:
             inline NoSweatConfigFileParser(std::string default_config_file);
             inline NoSweatConfigFileParser(std::string default_config_file, std::string config_file);
+            // Load both files from a binary cache written by
+            // write_config_cache() if it has been written for their current
+            // contents. Otherwise parse them and write the cache.
+            inline NoSweatConfigFileParser(std::string default_config_file, std::string config_file,
+                                           std::string cache_file);
+            inline NoSweatConfigFileParser(const NoSweatConfigFileParser& other);
+            NoSweatConfigFileParser(NoSweatConfigFileParser&&) = default;
             inline ~NoSweatConfigFileParser();
+            // Write the configuration to std::cout, see emit_configuration().
             inline void print_configuration();
-            inline int get_int(std::string key);
-            inline float get_float(std::string key);
-            inline std::string get_string(std::string key);
-            inline bool get_bool(std::string key);
-            inline void read_config_file(std::string config_file);
+            // Write all keys with their current values, grouped by section
+            // and sorted by key. EmitFormat::Config parses back to the same
+            // keys and values, EmitFormat::Json is an object of the qualified
+            // keys. If only_changed is set, keys with their default value are
+            // left out. The text is built from one snapshot first and written
+            // in blocks afterwards, so a slow output does not delay reloads.
+            // Return the size of the whole text. It is truncated to the size
+            // of the buffer, which is not null-terminated.
+            inline std::size_t emit_configuration(char* buffer, std::size_t size,
+                                                  EmitFormat format = EmitFormat::Config,
+                                                  bool only_changed = false) const;
+#ifdef NOSWEAT_HAVE_MMAP
+            // Return false if writing to the file descriptor fails.
+            inline bool emit_configuration(int fd, EmitFormat format = EmitFormat::Config,
+                                           bool only_changed = false) const;
+#endif
+            inline void emit_configuration(std::ostream& stream, EmitFormat format = EmitFormat::Config,
+                                           bool only_changed = false) const;
+            // Keys can be given as std::string, string literal or StringRef
+            // and are never copied.
+            inline int get_int(StringRef key) const;
+            inline float get_float(StringRef key) const;
+            inline std::string get_string(StringRef key) const;
+            inline bool get_bool(StringRef key) const;
+            inline std::int64_t get_int64(StringRef key) const;
+            inline double get_double(StringRef key) const;
+            // Copies of array values. Read them through a ConfigView to
+            // get an ArrayRef without copying.
+            inline std::vector<int> get_int_array(StringRef key) const;
+            inline std::vector<float> get_float_array(StringRef key) const;
+            inline std::vector<std::int64_t> get_int64_array(StringRef key) const;
+            inline std::vector<double> get_double_array(StringRef key) const;
+            // The same by interned id, without hashing or comparing the key.
+            inline int get_int(KeyId id) const;
+            inline float get_float(KeyId id) const;
+            inline std::string get_string(KeyId id) const;
+            inline bool get_bool(KeyId id) const;
+            inline std::int64_t get_int64(KeyId id) const;
+            inline double get_double(KeyId id) const;
+            inline std::vector<int> get_int_array(KeyId id) const;
+            inline std::vector<float> get_float_array(KeyId id) const;
+            inline std::vector<std::int64_t> get_int64_array(KeyId id) const;
+            inline std::vector<double> get_double_array(KeyId id) const;
+            // The id of a key, or an invalid id if the key does not exist.
+            inline KeyId key_id(StringRef key) const;
+            // The interned key of an id, or an empty key for invalid ids.
+            inline StringRef key_name(KeyId id) const;
+            // The entries of a section and its subsections, sorted by their
+            // qualified keys.
+            inline std::vector<const ConfigEntry*> section_entries(StringRef section) const;
+            // The entries whose qualified keys start with prefix, sorted.
+            inline std::vector<const ConfigEntry*> keys_with_prefix(StringRef prefix) const;
+            // The names of all sections of the default configuration, sorted.
+            inline std::vector<std::string> sections() const;
+            // Resolve a key to a typed handle, e.g. get_handle<int>("key").
+            template<typename T>
+            inline Handle<T> get_handle(StringRef key) const;
+            // Add the keys of a schema declared with NOSWEAT_CONFIG_SCHEMA as
+            // if they were in the default configuration file, with the
+            // members of schema as default values.
+            template<typename Schema>
+            inline void add_schema(const Schema& schema);
+            // Set the members of the schema to the current values of their
+            // keys, all from the same point in time. Members whose key does
+            // not exist with the type of the member are left unchanged.
+            template<typename Schema>
+            inline void fill(Schema& schema) const;
+            // Reading a configuration file returns the keys whose values
+            // changed. If the values are the result of reading a file before,
+            // only the lines that differ from that file are parsed again.
+            inline ChangeSet read_config_file(std::string config_file);
+            // Read the configuration file again, starting from the default
+            // values, and atomically replace all user set values.
+            inline ChangeSet reload_config_file();
+            // Path of the last read configuration file.
+            inline std::string config_file() const;
+            // Read counts, misses and parse phase times recorded so far if
+            // compiled with NOSWEAT_INSTRUMENTATION defined.
+            inline InstrumentationStats instrumentation_stats() const;
+            inline void dump_instrumentation(std::ostream& stream) const;
+            // Call callback(key, old_value, new_value) whenever reading a
+            // configuration changes the value of the key, e.g.
+            // subscribe<int>("key", [](StringRef key, int old_value, int new_value) {...}).
+            // All callbacks of a read are called together once the new values
+            // are visible, on the reading thread. They may read values but
+            // must not read configurations into the same parser.
+            template<typename T>
+            inline std::size_t subscribe(const std::string& key, std::function<void(
+                StringRef, typename ValueTraits<T>::result_type, typename ValueTraits<T>::result_type)> callback);
+            // Same as subscribe() for all keys of type T starting with prefix.
+            template<typename T>
+            inline std::size_t subscribe_prefix(const std::string& prefix, std::function<void(
+                StringRef, typename ValueTraits<T>::result_type, typename ValueTraits<T>::result_type)> callback);
+            inline void unsubscribe(std::size_t id);
+            // Same as parsing a default/user configuration file, but with the
+            // file contents provided by the caller. The buffer is not copied
+            // and does not have to outlive the call.
+            inline void parse_default_config_buffer(const char* data, std::size_t size);
+            inline ChangeSet read_config_buffer(const char* data, std::size_t size);
+            // Parse several default configuration files concurrently. The
+            // result is the same as parsing them one after the other: the
+            // first occurrence of a key wins.
+            inline void parse_default_config_files(const std::vector<std::string>& default_config_files);
+            // Read several configuration files concurrently on top of the
+            // current values. The result is the same as reading them one
+            // after the other: later files take precedence.
+            // reload_config_file() reloads the last one.
+            inline ChangeSet read_config_files(const std::vector<std::string>& config_files);
+            // Override values with "--set key=value" (or "--set=key=value")
+            // command line arguments and, if environment_prefix is not
+            // empty, with the environment variables starting with it, e.g.
+            // MYAPP_port=8080 for the prefix "MYAPP_". Variable names are
+            // taken as key, or else lower-cased with "__" separating
+            // sections. As in configuration files, values have to convert to
+            // the type of the key. Other arguments, unknown keys and invalid
+            // values are ignored, and arguments take precedence over the
+            // environment. All overrides are applied at once, and again on
+            // top of every configuration read afterwards. Neither argv nor
+            // the environment are copied, so they must not change.
+            inline ChangeSet apply_overrides(int argc, const char* const* argv,
+                                             const std::string& environment_prefix = std::string());
+            // Parse buffers of more than a few megabytes in chunks on up to
+            // the given number of threads, or one per core if zero. Defaults
+            // to a single thread.
+            void set_parser_threads(unsigned threads) { parser_threads_ = threads; }
+            // Accept a case-insensitive literal as boolean value in lines
+            // parsed from now on, e.g. add_boolean_literal("enabled", true).
+            // Return false if it is longer than LiteralTable::max_literal_size.
+            inline bool add_boolean_literal(const std::string& literal, bool value);
+            // Accept a keyword as name of a type in lines parsed from now on,
+            // e.g. add_type_keyword("integer", ValueType::Integer). Return
+            // false for keywords with whitespace or that are too long.
+            inline bool add_type_keyword(const std::string& keyword, ValueType type);
+            // Paths of the *.cfg and *.conf files in a directory such as
+            // conf.d, sorted by name.
+            static inline std::vector<std::string> config_directory_files(const std::string& directory);
+            // Write all keys with their default and current values to a
+            // binary cache. Only possible if the values are the result of
+            // parsing a default configuration file and then reading a
+            // configuration file. Return false if no cache has been written.
+            inline bool write_config_cache(const std::string& cache_file) const;
+
+            // All get_*() methods and handles are safe to use while other
+            // threads read or reload the user configuration. Default
+            // configuration files must not be parsed concurrently to reading.
 
         private:
+            friend class ConfigView;
+            friend class ConfigStream;
+            friend class SharedConfigRegion;
             inline NoSweatConfigFileParser();
             inline void parse_default_config_file();
-            inline bool is_key_available(std::string key);
-
-            // Convert the string value to the corresponding type and add to the default key/value maps.
-            inline void add_default_integer_value(const std::string key, const std::string value);
-            inline void add_default_float_value(const std::string key, const std::string value);
-            inline void add_default_string_value(const std::string key, std::string value);
-            inline void add_default_bool_value(const std::string key, std::string value);
-
-            // Set an already existing key to a value. If the key does not exist, nothing will happen.
-            inline void set_integer_value(const std::string key, const std::string value);
-            inline void set_float_value(const std::string key, const std::string value);
-            inline void set_string_value(const std::string key, std::string value);
-            inline void set_bool_value(const std::string key, std::string value);
-            // Set a given key to value. Will search all maps and determine the key automatically.
-            inline void set_value(const std::string key, std::string value);
-
-            // Accepted types of configuration variables. The additional space
-            // is important because otherwise it could as well be a key name.
-            const std::vector<std::string> accepted_value_types_{"int ", "float ", "string ", "bool "};
-            const std::string accepted_assignment_operators_{":="};
+            inline bool is_key_available(StringRef key) const;
+            // The entry of the key if it has the given type, otherwise nullptr.
+            inline const ConfigEntry* find_entry(StringRef key, ValueType type) const;
+            // The current value of the key or the default value of the type.
+            template<typename T>
+            inline typename ValueTraits<T>::value_type get_value(StringRef key) const;
+            template<typename T>
+            inline typename ValueTraits<T>::value_type get_value(KeyId id) const;
+            // A line of the last read configuration file.
+            struct LineRecord {
+                std::uint64_t hash;
+                // Id of the entry the line sets or UINT32_MAX.
+                std::uint32_t id;
+            };
+
+            // The binary cache consists of a CacheHeader, the CacheEntries of
+            // all keys, the LineRecords of the configuration file and the
+            // strings. It is used in place: keys and strings of the loaded
+            // values point into the mapped file.
+            struct CacheHeader {
+                char magic[8];
+                std::uint32_t version;
+                // To detect caches written on a machine with another byte order.
+                std::uint32_t byte_order;
+                // Hash of everything after the header.
+                std::uint64_t checksum;
+                std::uint64_t size;
+                // Hashes of the contents of the parsed files.
+                std::uint64_t default_config_hash;
+                std::uint64_t config_hash;
+                std::uint32_t entry_count;
+                std::uint32_t line_count;
+            };
+            // Numbers are stored in scalar, strings relative to the start of the strings.
+            struct CacheValue {
+                std::uint64_t scalar;
+                std::uint64_t string_offset;
+                std::uint32_t string_size;
+                std::uint32_t reserved;
+            };
+            struct CacheEntry {
+                std::uint64_t key_offset;
+                std::uint32_t key_size;
+                std::uint32_t type;
+                // The key is stored qualified with its section.
+                std::uint32_t section_size;
+                std::uint32_t reserved;
+                CacheValue default_value;
+                CacheValue value;
+            };
+            // Replace all keys and values with the contents of the cache if
+            // it is valid and has been written for the current contents of
+            // the default and user configuration files.
+            inline bool read_config_cache(const std::string& cache_file);
+            static inline CacheValue cache_value(ValueType type, const ConfigValue& value, std::string& strings);
+            static inline ConfigValue cached_value(ValueType type, const CacheValue& cached, const char* strings);
+
+            // A configuration line tokenized and converted ahead of applying
+            // it, so lines can be parsed concurrently. The entry is only set
+            // for user configuration lines, the hash of the key only for
+            // default configuration lines.
+            struct ParsedLine {
+                const ConfigEntry* entry;
+                std::uint64_t key_hash;
+                ConfigLine line;
+                ConfigValue value;
+            };
+            // The valid lines of a default configuration buffer. Their keys
+            // and strings are copied to a single block, so the keys can be
+            // added without copying them one by one.
+            struct ParsedDefaults {
+                std::vector<ParsedLine> lines;
+                std::unique_ptr<char[]> strings;
+                // The elements of arrays, converted in place.
+                StringStorage arrays;
+            };
+            // Parse all valid lines of a default/user configuration buffer.
+            // Neither modifies the parser, so they can run concurrently.
+            // Parsing starts in the given section.
+            inline void parse_default_lines(const char* data, std::size_t size, StringRef section,
+                                            ParsedDefaults& defaults) const;
+            inline void parse_user_lines(const char* data, std::size_t size, StringRef section,
+                                         std::vector<ParsedLine>& lines, StringStorage& arrays,
+                                         std::vector<LineRecord>* records = nullptr) const;
+            // Split the buffer into chunks ending after a newline to parse
+            // them concurrently, or return it as a single chunk.
+            inline std::vector<StringRef> parse_chunks(const char* data, std::size_t size) const;
+            // The section each chunk starts in.
+            inline std::vector<StringRef> chunk_sections(const std::vector<StringRef>& chunks) const;
+            // Find the section of the last header in the text.
+            static inline bool last_section_header(StringRef text, StringRef& section);
+            // Add/apply parsed lines in the order they appeared.
+            inline void add_default_lines(std::vector<ParsedDefaults>& defaults);
+            inline void apply_user_lines(ValueSnapshot& snapshot, const std::vector<ParsedLine>& lines) const;
+
+            // Apply a user configuration on top of the values in snapshot.
+            // Records of all lines are appended to records if given.
+            inline void apply_config_buffer(ValueSnapshot& snapshot, const char* data, std::size_t size,
+                                            std::vector<LineRecord>* records = nullptr);
+            // Read config_file_ on top of the current or the default values and publish the result.
+            inline ChangeSet apply_config_file(bool from_defaults);
+            // Publish the new values and notify the subscribers of the changes.
+            inline void publish(ValueSnapshot* snapshot, const ChangeSet& changes);
+            template<typename T>
+            inline std::size_t subscribe(const std::string& key, bool is_prefix, std::function<void(
+                StringRef, typename ValueTraits<T>::result_type, typename ValueTraits<T>::result_type)> callback);
+            // Apply only the lines that differ from config_lines_ on top of
+            // a copy of the current values.
+            inline ChangeSet apply_changed_lines(ValueSnapshot& snapshot, const char* data, std::size_t size,
+                                                 bool from_defaults);
+            // The entries whose values differ between the snapshots.
+            inline ChangeSet changed_entries(const ValueSnapshot& old_values, const ValueSnapshot& new_values) const;
+
+            // Split a trimmed line into type, key and value. Return false if
+            // the line is not a valid default/user configuration line.
+            // assignment_index is the position of the first assignment
+            // operator in the line as found by the LineScanner.
+            inline bool tokenize_default_line(StringRef line, std::size_t assignment_index,
+                                              ConfigLine& config_line) const;
+            static inline bool tokenize_user_line(const LiteralTable& type_keywords, StringRef line,
+                                                  std::size_t assignment_index, ConfigLine& config_line);
+            // Type of the value keyword the line starts with, if any.
+            static inline ValueType leading_value_type(const LiteralTable& type_keywords, StringRef line);
+            // If the trimmed line is a section header "[name]", set section
+            // to the trimmed name. "[]" ends the current section.
+            static inline bool section_header(StringRef line, StringRef& section);
+            inline bool convert_to_bool(StringRef str, bool& value) const;
+            // Convert a string to a number, boolean or array value. Strings
+            // need no conversion. The elements of arrays are stored in arrays.
+            inline bool convert_value(ValueType type, StringRef str, ConfigValue& value,
+                                      StringStorage& arrays) const;
+
+            // Convert the string value of a line to its type and add it as a new key.
+            inline void add_default_value(const ConfigLine& config_line, StringStorage& arrays, PhaseClock& clock);
+            // Add a new key with a typed default value.
+            inline void add_default_value(StringRef key, int value);
+            inline void add_default_value(StringRef key, float value);
+            inline void add_default_value(StringRef key, bool value);
+            inline void add_default_value(StringRef key, std::int64_t value);
+            inline void add_default_value(StringRef key, double value);
+            inline void add_default_value(StringRef key, const std::string& value);
+            // Make keys added since the last parse visible.
+            inline void publish_new_keys();
+
+            // Visitors of the members of schemas.
+            struct SchemaDefaults {
+                NoSweatConfigFileParser& parser;
+                template<typename T>
+                void operator()(const char* key, const T& value) {
+                    static_assert(IsSchemaMember<T>::value, "Arrays are not supported in NOSWEAT_CONFIG_SCHEMA, read them with get_*_array() or a Handle");
+                    // Keys of sections are also taken by their plain name.
+                    if (!parser.values_.find(key))
+                        parser.add_default_value(key, value);
+                }
+            };
+            struct SchemaFiller {
+                const NoSweatConfigFileParser& parser;
+                const ValueSnapshot& snapshot;
+                template<typename T>
+                void operator()(const char* key, T& value) {
+                    static_assert(IsSchemaMember<T>::value, "Arrays are not supported in NOSWEAT_CONFIG_SCHEMA, read them with get_*_array() or a Handle");
+                    const ConfigEntry* entry = parser.find_entry(key, ValueTraits<T>::type);
+                    if (!entry)
+                        return;
+                    parser.snapshots_->instrumentation().record_read(entry->id);
+                    value = typename ValueTraits<T>::value_type(ValueTraits<T>::get(snapshot[entry->id]));
+                }
+            };
+            // The [section] user configuration lines are in. Keys in sections
+            // the default configuration does not have, e.g. in INI files
+            // grouped differently, are looked up by their key alone.
+            struct UserSection {
+                StringRef name;
+                bool is_known;
+            };
+            UserSection user_section(StringRef name) const { return UserSection{name, values_.has_section(name)}; }
+            // Tokenize a user line and convert its value. Return the entry
+            // the line sets, or nullptr if the key does not exist, the type
+            // given in the line does not match or the value does not convert.
+            // String values are not copied and stay in config_line.value.
+            // The elements of arrays are stored in arrays until they are set.
+            inline const ConfigEntry* resolve_user_line(StringRef line, std::size_t assignment_index,
+                                                        const UserSection& section, ConfigLine& config_line,
+                                                        ConfigValue& value, StringStorage& arrays,
+                                                        PhaseClock& clock) const;
+            // Set the entry to the value of a line resolved before.
+            inline void set_value(ValueSnapshot& snapshot, const ConfigEntry& entry, const ConfigLine& config_line,
+                                  const ConfigValue& value) const;
+            // Append the text of emit_configuration() to text.
+            inline void emit_text(EmitFormat format, bool only_changed, std::string& text) const;
+            // Call write(data, size) with blocks of at most emit_block_size
+            // bytes of the text of emit_configuration().
+            template<typename Write>
+            inline void emit(EmitFormat format, bool only_changed, Write write) const;
+            static const std::size_t emit_block_size = 1 << 16;
+            // A value set by apply_overrides(), pointing into argv or the environment.
+            struct Override {
+                std::uint32_t id;
+                StringRef value;
+            };
+            // Resolve an environment variable "name=value" without the prefix.
+            inline bool resolve_environment_variable(StringRef variable, Override& resolved) const;
+            // Set the overridden values on top of the values in snapshot.
+            inline void set_overrides(ValueSnapshot& snapshot, const std::vector<Override>& overrides) const;
+
+            // Type keywords, each followed by a space.
+            LiteralTable value_type_keywords_ = default_type_keywords();
             // Case-insensitive accepted names for the boolean values.
-            const std::vector<std::string> accepted_boolean_true_values_{"true", "yes", "y", "on", "1", "right"};
-            const std::vector<std::string> accepted_boolean_false_values_{"false", "no", "n", "off", "0", "wrong"};
+            LiteralTable boolean_literals_{false, {
+                {"true", 1}, {"yes", 1}, {"y", 1}, {"on", 1}, {"1", 1}, {"right", 1},
+                {"false", 0}, {"no", 0}, {"n", 0}, {"off", 0}, {"0", 0}, {"wrong", 0}}};
             // Path of the default configuration file.
             std::string default_config_file_;
             // Path of the configuration file.
             std::string config_file_;
-            // Store all the configuration values in there. The first value in
-            // the pair is always the default value and the second value is the
-            // user set value. If no user set value was given at any point the
-            // second value will also be the default value.
-            std::map<std::string, std::pair<int, int>> integer_config_values_;
-            std::map<std::string, std::pair<float, float>> float_config_values_;
-            std::map<std::string, std::pair<std::string, std::string>> string_config_values_;
-            std::map<std::string, std::pair<bool, bool>> bool_config_values_;
+            // Maximum number of threads parsing a single buffer.
+            unsigned parser_threads_;
+            // Hashes of the contents of the last parsed files. The default
+            // one is only valid if a single default file has been parsed.
+            std::uint64_t default_config_hash_;
+            bool default_config_hash_valid_;
+            std::uint64_t config_hash_;
+            // The loaded binary cache. Declared before the values referring to it.
+            std::unique_ptr<MappedFile> cache_;
+            // Store all the configuration keys with their default values in there.
+            ValueStore values_;
+            // The user set values. Kept on the heap so handles stay valid when the parser is moved.
+            std::unique_ptr<SnapshotPointer> snapshots_;
+            // Subscriptions to changes. Kept on the heap so the parser stays movable.
+            std::unique_ptr<ChangeNotifier> notifier_;
+            // Whether the current values are the default values.
+            bool is_default_snapshot_;
+            // The lines of the last read configuration file. Valid if the
+            // current values are the result of reading it, with the
+            // overrides on top, and nothing else has been read or parsed since.
+            std::vector<LineRecord> config_lines_;
+            bool config_lines_valid_;
+            // Whether all keys not set by config_lines_ have their default value.
+            bool config_lines_on_defaults_;
+            // Applied on top of every configuration read.
+            std::vector<Override> overrides_;
     };
 
+    // Characters assigning a value to a key, shared by the parser, the line
+    // scanner and ConfigStream.
+    constexpr char assignment_operators[] = ":=";
     inline void trim(std::string& str);
     inline bool starts_with(const std::string str, const std::string substr);
+    // True if the trimmed line is a comment, starting with '#' or ';'.
+    inline bool is_comment(StringRef trimmed_line);
+    // Trim the line and move the index of its first assignment operator accordingly.
+    inline StringRef trim_line(StringRef line, std::size_t& assignment_index);
+    // The trimmed first line of a value continued on the following lines.
+    // Only arrays are continued, all other values end with their line.
+    inline StringRef first_line(StringRef value);
+    // Conversions of decimal numbers without exceptions, heap allocations
+    // (except for unusually long floating point numbers) or dependency on
+    // the locale. The whole string has to be a number in the range of the
+    // type, e.g. "12abc" or "1.5" are no integers.
+    inline bool convert_to_int(StringRef str, int& value);
+    inline bool convert_to_int64(StringRef str, std::int64_t& value);
+    inline bool convert_to_float(StringRef str, float& value);
+    inline bool convert_to_double(StringRef str, double& value);
+    // Split an optionally signed decimal integer into sign and magnitude.
+    inline bool parse_decimal_integer(StringRef str, bool& negative, std::uint64_t& magnitude);
+    // Value of eight decimal digits, or false if not all of them are digits.
+    inline bool parse_eight_digits(const char* digits, std::uint32_t& value);
+    template<typename T>
+    inline bool convert_to_floating_point(StringRef str, T& value);
+    // Convert a list of numbers separated by commas, e.g. "0.1, 0.2,\n0.3",
+    // to the elements of an array of the given type, stored in arrays. A
+    // trailing comma is allowed. value is set to the elements.
+    inline bool convert_to_array(ValueType type, StringRef str, ConfigValue& value, StringStorage& arrays);
+    template<typename T, typename Convert>
+    inline bool convert_elements(StringRef str, ConfigValue& value, StringStorage& arrays, Convert convert);
+    // Size of the elements of an array type, zero for all other types.
+    inline std::size_t array_element_size(ValueType type);
+    // Append numbers in decimal, independent of the locale. Floating point
+    // numbers get the fewest digits that convert back to the same value.
+    inline void append_integer(std::string& output, std::int64_t value);
+    template<typename T>
+    inline void append_floating_point(std::string& output, T value);
+    // Append a value in the syntax of configuration files or of JSON.
+    inline void append_value(std::string& output, ValueType type, const ConfigValue& value, EmitFormat format);
+    // Append a quoted and escaped JSON string.
+    inline void append_json_string(std::string& output, StringRef str);
+    inline bool values_equal(ValueType type, const ConfigValue& lhs, const ConfigValue& rhs);
+    // Call task(i) for all i < count on up to max_threads threads, or one
+    // per core if max_threads is zero.
+    template<typename Task>
+    inline void parallel_for(std::size_t count, unsigned max_threads, Task task);
+    // The type keyword of configuration files, e.g. "int".
+    inline const char* value_type_name(ValueType type);
+    // Hash of keys and lines.
+    inline std::uint64_t hash_key(StringRef key);
+    // Hash of "section.key" without joining them, or of the key if section is empty.
+    inline std::uint64_t hash_key(StringRef section, StringRef key);
+    // Faster hash of whole files, eight bytes at a time.
+    inline std::uint64_t hash_bytes(StringRef bytes);
 }
 
 
+/// Declares a configuration schema NAME: a struct with one member per key,
+/// initialized to the key's default value, so reading a value is a plain
+/// member access and unknown keys or wrong types do not compile. KEYS is a
+/// macro that applies its argument to (type, key, default value) of every
+/// key. The type is one of int, float, std::string, bool, std::int64_t and
+/// double; arrays are not supported and fail with a static_assert.
+///
+///     #define SERVER_CONFIG(KEY) KEY(int, max_number_of_users, 1) KEY(std::string, username, "some_user")
+///     NOSWEAT_CONFIG_SCHEMA(ServerConfig, SERVER_CONFIG)
+///
+/// ServerConfig::max_number_of_users_index is the compile-time index of a
+/// key and ServerConfig::key_count the number of keys. The struct is filled
+/// in with NoSweatConfigFileParser::fill().
+#define NOSWEAT_CONFIG_SCHEMA(NAME, KEYS) \
+    struct NAME { \
+        KEYS(NOSWEAT_SCHEMA_MEMBER_) \
+        enum Index { KEYS(NOSWEAT_SCHEMA_INDEX_) key_count }; \
+        /* Call visitor(key, member) for all keys in declaration order. */ \
+        template<typename Visitor> void visit(Visitor& visitor) { KEYS(NOSWEAT_SCHEMA_VISIT_) } \
+        template<typename Visitor> void visit(Visitor& visitor) const { KEYS(NOSWEAT_SCHEMA_VISIT_) } \
+    };
+#define NOSWEAT_SCHEMA_MEMBER_(TYPE, KEY, DEFAULT) TYPE KEY = DEFAULT;
+#define NOSWEAT_SCHEMA_INDEX_(TYPE, KEY, DEFAULT) KEY##_index,
+#define NOSWEAT_SCHEMA_VISIT_(TYPE, KEY, DEFAULT) visitor(#KEY, KEY);
+
+
 /// The constructor takes the paths of the default configuration file and of the
 /// normal configuration file and parses them both upon construction.
 NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser(std::string default_config_file, std::string config_file)
-: default_config_file_(default_config_file) {
+: default_config_file_(default_config_file), parser_threads_(1), default_config_hash_(0),
+  default_config_hash_valid_(false), config_hash_(0), snapshots_(new SnapshotPointer(new ValueSnapshot(values_))),
+  notifier_(new ChangeNotifier()), is_default_snapshot_(true), config_lines_valid_(false), config_lines_on_defaults_(false) {
     // Parse both config files.
     parse_default_config_file();
     read_config_file(config_file);
 }
 
-NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser(std::string default_config_file)
-: default_config_file_(default_config_file) {
-    parse_default_config_file();
+NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser(std::string default_config_file)
+: default_config_file_(default_config_file), parser_threads_(1), default_config_hash_(0),
+  default_config_hash_valid_(false), config_hash_(0), snapshots_(new SnapshotPointer(new ValueSnapshot(values_))),
+  notifier_(new ChangeNotifier()), is_default_snapshot_(true), config_lines_valid_(false), config_lines_on_defaults_(false) {
+    parse_default_config_file();
+}
+
+
+NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser(std::string default_config_file, std::string config_file,
+                                                          std::string cache_file)
+: default_config_file_(default_config_file), config_file_(config_file), parser_threads_(1), default_config_hash_(0),
+  default_config_hash_valid_(false), config_hash_(0), snapshots_(new SnapshotPointer(new ValueSnapshot(values_))),
+  notifier_(new ChangeNotifier()), is_default_snapshot_(true), config_lines_valid_(false),
+  config_lines_on_defaults_(false) {
+    if (read_config_cache(cache_file))
+        return;
+    parse_default_config_file();
+    read_config_file(config_file);
+    write_config_cache(cache_file);
+}
+
+
+/// Copies do not share any values or subscriptions.
+NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser(const NoSweatConfigFileParser& other)
+: value_type_keywords_(other.value_type_keywords_), boolean_literals_(other.boolean_literals_),
+  default_config_file_(other.default_config_file_), config_file_(other.config_file_),
+  parser_threads_(other.parser_threads_), default_config_hash_(other.default_config_hash_), default_config_hash_valid_(other.default_config_hash_valid_),
+  config_hash_(other.config_hash_), values_(other.values_), notifier_(new ChangeNotifier()), is_default_snapshot_(false), config_lines_valid_(false), config_lines_on_defaults_(false),
+  overrides_(other.overrides_) {
+    SnapshotPointer::ReadGuard guard{*other.snapshots_};
+    snapshots_.reset(new SnapshotPointer(new ValueSnapshot(*guard, values_)));
+}
+
+
+NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser()
+: parser_threads_(1), default_config_hash_(0), default_config_hash_valid_(false), config_hash_(0), snapshots_(new SnapshotPointer(new ValueSnapshot(values_))), notifier_(new ChangeNotifier()),
+  is_default_snapshot_(true), config_lines_valid_(false), config_lines_on_defaults_(false) {};
+NoSweat::NoSweatConfigFileParser::~NoSweatConfigFileParser() {};
+
+
+/// Keys are written in the syntax of the default configuration file, so the
+/// output can be parsed again.
+void NoSweat::NoSweatConfigFileParser::print_configuration() {
+    std::cout << "# NoSweatConfigFileParser object: default_config_file='" << default_config_file_ <<
+        "', config_file='" << config_file_ << "'\n";
+    emit_configuration(std::cout);
+    std::cout.flush();
+}
+
+
+std::size_t NoSweat::NoSweatConfigFileParser::emit_configuration(char* buffer, std::size_t size, EmitFormat format,
+                                                                 bool only_changed) const {
+    std::size_t total_size = 0;
+    emit(format, only_changed, [&](const char* data, std::size_t data_size) {
+        if (total_size < size)
+            std::memcpy(buffer + total_size, data, std::min(data_size, size - total_size));
+        total_size += data_size;
+    });
+    return total_size;
+}
+
+
+#ifdef NOSWEAT_HAVE_MMAP
+bool NoSweat::NoSweatConfigFileParser::emit_configuration(int fd, EmitFormat format, bool only_changed) const {
+    bool is_written = true;
+    emit(format, only_changed, [&](const char* data, std::size_t size) {
+        while (is_written && size) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            is_written = written > 0;
+            if (is_written) {
+                data += written;
+                size -= static_cast<std::size_t>(written);
+            }
+        }
+    });
+    return is_written;
+}
+#endif
+
+
+void NoSweat::NoSweatConfigFileParser::emit_configuration(std::ostream& stream, EmitFormat format,
+                                                          bool only_changed) const {
+    emit(format, only_changed, [&](const char* data, std::size_t size) {
+        stream.write(data, static_cast<std::streamsize>(size));
+    });
+}
+
+
+/// Sorted by section first, so that every section is a single group below
+/// its header and the keys outside of sections come before the first one.
+void NoSweat::NoSweatConfigFileParser::emit_text(EmitFormat format, bool only_changed, std::string& text) const {
+    SnapshotPointer::ReadGuard snapshot{*snapshots_};
+    std::vector<const ConfigEntry*> entries;
+    entries.reserve(values_.size());
+    for (const ConfigEntry& entry: values_.entries()) {
+        if (!only_changed || !values_equal(entry.type, (*snapshot)[entry.id], entry.default_value))
+            entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const ConfigEntry* lhs, const ConfigEntry* rhs) {
+        const StringRef lhs_section = lhs->section();
+        const StringRef rhs_section = rhs->section();
+        return lhs_section < rhs_section || (lhs_section == rhs_section && lhs->key < rhs->key);
+    });
+
+    if (format == EmitFormat::Json)
+        text += '{';
+    StringRef section;
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        const ConfigEntry& entry = *entries[i];
+        if (format == EmitFormat::Json) {
+            text += i ? ",\n  " : "\n  ";
+            append_json_string(text, entry.qualified_key());
+            text += ": ";
+        }
+        else {
+            if (entry.section() != section) {
+                section = entry.section();
+                text += i ? "\n[" : "[";
+                text.append(section.data(), section.size());
+                text += "]\n";
+            }
+            text += value_type_name(entry.type);
+            text += ' ';
+            text.append(entry.key.data(), entry.key.size());
+            text += " = ";
+        }
+        append_value(text, entry.type, (*snapshot)[entry.id], format);
+        if (format == EmitFormat::Config)
+            text += '\n';
+    }
+    if (format == EmitFormat::Json)
+        text += entries.empty() ? "}\n" : "\n}\n";
+}
+
+
+/// The text is built before anything is written, so the snapshot is not
+/// held while a slow pipe or stream blocks and writers do not wait for it.
+template<typename Write>
+void NoSweat::NoSweatConfigFileParser::emit(EmitFormat format, bool only_changed, Write write) const {
+    std::string text;
+    emit_text(format, only_changed, text);
+    for (std::size_t offset = 0; offset < text.size(); offset += emit_block_size) {
+        const std::size_t size = text.size() - offset;
+        write(text.data() + offset, size < emit_block_size ? size : std::size_t(emit_block_size));
+    }
+}
+
+
+void NoSweat::NoSweatConfigFileParser::parse_default_config_file() {
+    PhaseClock clock{snapshots_->instrumentation()};
+    MappedFile file{default_config_file_};
+    clock.lap(Phase::Io);
+    if (file.is_open()) {
+        const bool is_first_file = values_.size() == 0;
+        parse_default_config_buffer(file.data(), file.size());
+        default_config_hash_ = hash_bytes(StringRef(file.data(), file.size()));
+        default_config_hash_valid_ = is_first_file;
+    }
+    else {
+        std::cout << "WARNING: Could not find the default configuration file " <<
+            default_config_file_ << "." << std::endl;
+    }
+}
+
+
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::read_config_file(std::string config_file) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    config_file_ = config_file;
+    return apply_config_file(false);
+}
+
+
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::reload_config_file() {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    return apply_config_file(true);
+}
+
+
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::apply_config_file(bool from_defaults) {
+    PhaseClock clock{snapshots_->instrumentation()};
+    MappedFile file{config_file_};
+    clock.lap(Phase::Io);
+    if (!file.is_open()) {
+        std::cout << "WARNING: Could not find the configuration file " <<
+            config_file_ << "." << std::endl;
+        return ChangeSet();
+    }
+    const ValueSnapshot& current = snapshots_->current();
+    std::unique_ptr<ValueSnapshot> snapshot;
+    ChangeSet changes;
+    // Starting from the default values, the current values can only be
+    // reused if all keys not set by the last file have their default value.
+    if (config_lines_valid_ && (config_lines_on_defaults_ || !from_defaults)) {
+        snapshot.reset(new ValueSnapshot(current, values_));
+        changes = apply_changed_lines(*snapshot, file.data(), file.size(), from_defaults);
+    }
+    else {
+        snapshot.reset(from_defaults ? new ValueSnapshot(values_) : new ValueSnapshot(current, values_));
+        config_lines_.clear();
+        apply_config_buffer(*snapshot, file.data(), file.size(), &config_lines_);
+        changes = changed_entries(current, *snapshot);
+        config_lines_valid_ = true;
+        config_lines_on_defaults_ = from_defaults || is_default_snapshot_;
+    }
+    if (!overrides_.empty()) {
+        set_overrides(*snapshot, overrides_);
+        changes = changed_entries(current, *snapshot);
+    }
+    config_hash_ = hash_bytes(StringRef(file.data(), file.size()));
+    is_default_snapshot_ = false;
+    publish(snapshot.release(), changes);
+    return changes;
+}
+
+
+/// The lines before the first and after the last difference to the last
+/// read file set the same values as before. Thus only the keys set by
+/// differing lines of either version can change. Each of them gets the value
+/// of its last line in the new version, or keeps its current (or default)
+/// value if there is none.
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::apply_changed_lines(ValueSnapshot& snapshot, const char* data,
+                                                                         std::size_t size, bool from_defaults) {
+    struct ScannedLine {
+        StringRef line;
+        std::size_t assignment_index;
+        UserSection section;
+    };
+    PhaseClock clock{snapshots_->instrumentation()};
+    std::vector<ScannedLine> lines;
+    std::vector<LineRecord> records;
+    lines.reserve(config_lines_.size());
+    records.reserve(config_lines_.size());
+    LineScanner scanner{data, size};
+    StringRef line;
+    std::size_t assignment_index;
+    StringRef section_name;
+    UserSection section = user_section(section_name);
+    while (scanner.next_statement(line, assignment_index)) {
+        line = trim_line(line, assignment_index);
+        if (section_header(line, section_name)) {
+            section = user_section(section_name);
+            // Header lines set nothing.
+            lines.push_back(ScannedLine{StringRef(), std::string::npos, section});
+            records.push_back(LineRecord{hash_key(line), UINT32_MAX});
+            continue;
+        }
+        lines.push_back(ScannedLine{line, assignment_index, section});
+        // Lines of sections differ from the same lines outside of them.
+        records.push_back(LineRecord{hash_key(section.name, line), UINT32_MAX});
+    }
+
+    // Find the unchanged lines at the beginning and the end.
+    const std::size_t common_size = std::min(records.size(), config_lines_.size());
+    std::size_t prefix = 0;
+    while (prefix < common_size && records[prefix].hash == config_lines_[prefix].hash) {
+        records[prefix].id = config_lines_[prefix].id;
+        prefix++;
+    }
+    std::size_t suffix = 0;
+    while (suffix < common_size - prefix &&
+           records[records.size() - 1 - suffix].hash == config_lines_[config_lines_.size() - 1 - suffix].hash) {
+        records[records.size() - 1 - suffix].id = config_lines_[config_lines_.size() - 1 - suffix].id;
+        suffix++;
+    }
+
+    // Keys set by the removed and the new lines.
+    std::vector<std::uint32_t> changed_ids;
+    for (std::size_t i = prefix; i < config_lines_.size() - suffix; i++) {
+        if (config_lines_[i].id != UINT32_MAX)
+            changed_ids.push_back(config_lines_[i].id);
+    }
+    ConfigLine config_line;
+    ConfigValue value;
+    StringStorage arrays;
+    for (std::size_t i = prefix; i < records.size() - suffix; i++) {
+        const ConfigEntry* entry = resolve_user_line(lines[i].line, lines[i].assignment_index, lines[i].section,
+                                                     config_line, value, arrays, clock);
+        if (entry) {
+            records[i].id = entry->id;
+            changed_ids.push_back(entry->id);
+        }
+    }
+    std::sort(changed_ids.begin(), changed_ids.end());
+    changed_ids.erase(std::unique(changed_ids.begin(), changed_ids.end()), changed_ids.end());
+
+    // Find the last line setting each of the keys.
+    std::vector<std::size_t> last_lines(changed_ids.size(), records.size());
+    std::size_t keys_left = changed_ids.size();
+    for (std::size_t i = records.size(); i-- > 0 && keys_left; ) {
+        if (records[i].id == UINT32_MAX)
+            continue;
+        auto id = std::lower_bound(changed_ids.begin(), changed_ids.end(), records[i].id);
+        if (id != changed_ids.end() && *id == records[i].id && last_lines[id - changed_ids.begin()] == records.size()) {
+            last_lines[id - changed_ids.begin()] = i;
+            keys_left--;
+        }
+    }
+
+    ChangeSet changes;
+    const ValueSnapshot& current = snapshots_->current();
+    for (std::size_t i = 0; i < changed_ids.size(); i++) {
+        const ConfigEntry& entry = values_.entry(changed_ids[i]);
+        if (last_lines[i] < records.size()) {
+            const ScannedLine& last_line = lines[last_lines[i]];
+            resolve_user_line(last_line.line, last_line.assignment_index, last_line.section, config_line, value,
+                              arrays, clock);
+            set_value(snapshot, entry, config_line, value);
+        }
+        else if (from_defaults) {
+            snapshot.set(entry, entry.default_value);
+        }
+        else if (!values_equal(entry.type, snapshot[entry.id], entry.default_value)) {
+            config_lines_on_defaults_ = false;
+        }
+        if (!values_equal(entry.type, current[entry.id], snapshot[entry.id]))
+            changes.push_back(&entry);
+    }
+    clock.lap(Phase::Insert);
+    config_lines_.swap(records);
+    return changes;
+}
+
+
+namespace NoSweat {
+    // Identifies cache files and their version.
+    static const char cache_magic[8] = {'N', 'S', 'W', 'C', 'A', 'C', 'H', 'E'};
+    static const std::uint32_t cache_version = 4;
+    static const std::uint32_t cache_byte_order = 0x01020304;
+}
+
+
+/// The cache is written to a temporary file first and then renamed, so
+/// concurrently starting processes never read a partially written cache.
+bool NoSweat::NoSweatConfigFileParser::write_config_cache(const std::string& cache_file) const {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    if (!default_config_hash_valid_ || !config_lines_valid_ || !config_lines_on_defaults_ || !overrides_.empty())
+        return false;
+    const ValueSnapshot& current = snapshots_->current();
+    std::vector<CacheEntry> entries;
+    entries.reserve(values_.size());
+    std::string strings;
+    for (const ConfigEntry& entry: values_.entries()) {
+        CacheEntry cache_entry = CacheEntry();
+        const StringRef qualified_key = entry.qualified_key();
+        cache_entry.key_offset = strings.size();
+        cache_entry.key_size = static_cast<std::uint32_t>(qualified_key.size());
+        cache_entry.section_size = entry.section_size;
+        strings.append(qualified_key.data(), qualified_key.size());
+        cache_entry.type = static_cast<std::uint32_t>(entry.type);
+        cache_entry.default_value = cache_value(entry.type, entry.default_value, strings);
+        cache_entry.value = cache_value(entry.type, current[entry.id], strings);
+        entries.push_back(cache_entry);
+    }
+    std::vector<LineRecord> lines(config_lines_.size(), LineRecord());
+    for (std::size_t i = 0; i < lines.size(); i++) {
+        lines[i].hash = config_lines_[i].hash;
+        lines[i].id = config_lines_[i].id;
+    }
+
+    std::string body;
+    body.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(CacheEntry));
+    body.append(reinterpret_cast<const char*>(lines.data()), lines.size() * sizeof(LineRecord));
+    body.append(strings);
+    CacheHeader header = CacheHeader();
+    std::memcpy(header.magic, cache_magic, sizeof(header.magic));
+    header.version = cache_version;
+    header.byte_order = cache_byte_order;
+    header.checksum = hash_bytes(body);
+    header.size = sizeof(CacheHeader) + body.size();
+    header.default_config_hash = default_config_hash_;
+    header.config_hash = config_hash_;
+    header.entry_count = static_cast<std::uint32_t>(entries.size());
+    header.line_count = static_cast<std::uint32_t>(lines.size());
+
+    std::string temporary_file = cache_file + ".tmp";
+#ifdef NOSWEAT_HAVE_MMAP
+    temporary_file += std::to_string(::getpid());
+#endif
+    {
+        std::ofstream file_stream{temporary_file, std::ios::out | std::ios::binary | std::ios::trunc};
+        file_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file_stream.write(body.data(), body.size());
+        if (!file_stream.good()) {
+            std::remove(temporary_file.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary_file.c_str(), cache_file.c_str()) != 0) {
+        std::remove(temporary_file.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/// Nothing is converted or copied: the keys are inserted into a new store
+/// pointing into the mapped cache and the values are taken as they are.
+bool NoSweat::NoSweatConfigFileParser::read_config_cache(const std::string& cache_file) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    std::unique_ptr<MappedFile> cache{new MappedFile(cache_file)};
+    CacheHeader header;
+    if (!cache->is_open() || cache->size() < sizeof(header))
+        return false;
+    std::memcpy(&header, cache->data(), sizeof(header));
+    const std::uint64_t strings_offset = sizeof(header) + std::uint64_t(header.entry_count) * sizeof(CacheEntry) +
+        std::uint64_t(header.line_count) * sizeof(LineRecord);
+    if (std::memcmp(header.magic, cache_magic, sizeof(header.magic)) != 0 || header.version != cache_version ||
+        header.byte_order != cache_byte_order || header.size != cache->size() || strings_offset > header.size)
+        return false;
+    const StringRef body{cache->data() + sizeof(header), cache->size() - sizeof(header)};
+    if (hash_bytes(body) != header.checksum)
+        return false;
+
+    // The cache has to be written for the current files.
+    MappedFile default_config{default_config_file_};
+    MappedFile config{config_file_};
+    if (!default_config.is_open() || !config.is_open() ||
+        hash_bytes(StringRef(default_config.data(), default_config.size())) != header.default_config_hash ||
+        hash_bytes(StringRef(config.data(), config.size())) != header.config_hash)
+        return false;
+
+    const char* strings = cache->data() + strings_offset;
+    const std::uint64_t strings_size = header.size - strings_offset;
+    auto is_valid_string = [strings_size](std::uint64_t offset, std::uint64_t size) {
+        return offset <= strings_size && size <= strings_size - offset;
+    };
+    // The elements of arrays are used in place and have to be aligned.
+    auto is_valid_array = [&](const CacheValue& value, std::size_t element_size) {
+        return value.string_size && (reinterpret_cast<std::uintptr_t>(strings) + value.string_offset) %
+            alignof(double) == 0 && is_valid_string(value.string_offset, std::uint64_t(value.string_size) * element_size);
+    };
+    ValueStore values;
+    values.reserve(header.entry_count);
+    std::vector<ConfigValue> user_values;
+    user_values.reserve(header.entry_count);
+    for (std::uint32_t i = 0; i < header.entry_count; i++) {
+        CacheEntry entry;
+        std::memcpy(&entry, cache->data() + sizeof(header) + i * sizeof(CacheEntry), sizeof(entry));
+        const ValueType type = static_cast<ValueType>(entry.type);
+        if (type == ValueType::Unknown || type > ValueType::DoubleArray ||
+            !is_valid_string(entry.key_offset, entry.key_size))
+            return false;
+        if (type == ValueType::String &&
+            (!is_valid_string(entry.default_value.string_offset, entry.default_value.string_size) ||
+             !is_valid_string(entry.value.string_offset, entry.value.string_size)))
+            return false;
+        if (array_element_size(type) &&
+            (!is_valid_array(entry.default_value, array_element_size(type)) ||
+             !is_valid_array(entry.value, array_element_size(type))))
+            return false;
+        if (!values.insert_external(StringRef(strings + entry.key_offset, entry.key_size), entry.section_size, type,
+                                    cached_value(type, entry.default_value, strings)))
+            return false;
+        user_values.push_back(cached_value(type, entry.value, strings));
+    }
+    std::vector<LineRecord> lines(header.line_count);
+    for (std::uint32_t i = 0; i < header.line_count; i++) {
+        std::memcpy(&lines[i], cache->data() + sizeof(header) + header.entry_count * sizeof(CacheEntry) +
+                    i * sizeof(LineRecord), sizeof(LineRecord));
+        if (lines[i].id != UINT32_MAX && lines[i].id >= header.entry_count)
+            return false;
+    }
+
+    // Replace everything.
+    values_ = std::move(values);
+    std::unique_ptr<ValueSnapshot> snapshot{new ValueSnapshot(values_)};
+    for (const ConfigEntry& entry: values_.entries())
+        snapshot->set(entry, user_values[entry.id]);
+    snapshots_->publish(snapshot.release());
+    cache_ = std::move(cache);
+    default_config_hash_ = header.default_config_hash;
+    default_config_hash_valid_ = true;
+    config_hash_ = header.config_hash;
+    config_lines_.swap(lines);
+    config_lines_valid_ = true;
+    config_lines_on_defaults_ = true;
+    is_default_snapshot_ = false;
+    return true;
+}
+
+
+NoSweat::NoSweatConfigFileParser::CacheValue NoSweat::NoSweatConfigFileParser::cache_value(
+        ValueType type, const ConfigValue& value, std::string& strings) {
+    CacheValue result = CacheValue();
+    switch (type) {
+        case ValueType::Integer:
+            result.scalar = static_cast<std::uint32_t>(value.integer);
+            break;
+        case ValueType::Float:
+            std::memcpy(&result.scalar, &value.floating, sizeof(value.floating));
+            break;
+        case ValueType::Integer64:
+            std::memcpy(&result.scalar, &value.integer64, sizeof(value.integer64));
+            break;
+        case ValueType::Double:
+            std::memcpy(&result.scalar, &value.floating64, sizeof(value.floating64));
+            break;
+        case ValueType::Bool:
+            result.scalar = value.boolean;
+            break;
+        case ValueType::String:
+            result.string_offset = strings.size();
+            result.string_size = value.string_size;
+            strings.append(value.string().data(), value.string_size);
+            break;
+        case ValueType::IntegerArray:
+        case ValueType::FloatArray:
+        case ValueType::Integer64Array:
+        case ValueType::DoubleArray:
+            // The strings start aligned in the file.
+            strings.append((alignof(double) - strings.size() % alignof(double)) % alignof(double), '\0');
+            result.string_offset = strings.size();
+            result.string_size = value.string_size;
+            strings.append(static_cast<const char*>(value.external_array),
+                           value.string_size * array_element_size(type));
+            break;
+        default:
+            break;
+    }
+    return result;
+}
+
+
+NoSweat::ConfigValue NoSweat::NoSweatConfigFileParser::cached_value(ValueType type, const CacheValue& cached,
+                                                                    const char* strings) {
+    ConfigValue value = ConfigValue();
+    switch (type) {
+        case ValueType::Integer:
+            value.integer = static_cast<int>(static_cast<std::uint32_t>(cached.scalar));
+            break;
+        case ValueType::Float:
+            std::memcpy(&value.floating, &cached.scalar, sizeof(value.floating));
+            break;
+        case ValueType::Integer64:
+            std::memcpy(&value.integer64, &cached.scalar, sizeof(value.integer64));
+            break;
+        case ValueType::Double:
+            std::memcpy(&value.floating64, &cached.scalar, sizeof(value.floating64));
+            break;
+        case ValueType::Bool:
+            value.boolean = cached.scalar != 0;
+            break;
+        case ValueType::String:
+            value.string_size = cached.string_size;
+            if (value.string_size <= ConfigValue::inline_capacity)
+                std::memcpy(value.inline_string, strings + cached.string_offset, value.string_size);
+            else
+                value.external_string = strings + cached.string_offset;
+            break;
+        case ValueType::IntegerArray:
+        case ValueType::FloatArray:
+        case ValueType::Integer64Array:
+        case ValueType::DoubleArray:
+            value.string_size = cached.string_size;
+            value.external_array = strings + cached.string_offset;
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+
+/// The old values are kept until the subscribers have been notified.
+void NoSweat::NoSweatConfigFileParser::publish(ValueSnapshot* snapshot, const ChangeSet& changes) {
+    std::unique_ptr<const ValueSnapshot> old_values = snapshots_->exchange(snapshot);
+    if (!changes.empty())
+        notifier_->notify(changes, *old_values, *snapshot);
+}
+
+
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::changed_entries(const ValueSnapshot& old_values,
+                                                                     const ValueSnapshot& new_values) const {
+    ChangeSet changes;
+    for (const ConfigEntry& entry: values_.entries()) {
+        if (entry.id < old_values.size() && !values_equal(entry.type, old_values[entry.id], new_values[entry.id]))
+            changes.push_back(&entry);
+    }
+    return changes;
+}
+
+
+std::string NoSweat::NoSweatConfigFileParser::config_file() const {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    return config_file_;
+}
+
+
+NoSweat::InstrumentationStats NoSweat::NoSweatConfigFileParser::instrumentation_stats() const {
+    InstrumentationStats stats = InstrumentationStats();
+    const Instrumentation& instrumentation = snapshots_->instrumentation();
+    instrumentation.stats(stats);
+    if (!stats.enabled)
+        return stats;
+    {
+        std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+        for (const ConfigEntry& entry: values_.entries()) {
+            const std::uint64_t reads = instrumentation.reads(entry.id);
+            if (reads)
+                stats.reads.push_back(KeyCount{entry.key.str(), entry.type, reads});
+        }
+    }
+    std::sort(stats.reads.begin(), stats.reads.end(), [](const KeyCount& lhs, const KeyCount& rhs) {
+        return lhs.count > rhs.count || (lhs.count == rhs.count && lhs.key < rhs.key);
+    });
+    return stats;
+}
+
+
+void NoSweat::NoSweatConfigFileParser::dump_instrumentation(std::ostream& stream) const {
+    const InstrumentationStats stats = instrumentation_stats();
+    if (!stats.enabled) {
+        stream << "Instrumentation is disabled. Define NOSWEAT_INSTRUMENTATION before including "
+            "NoSweatConfigFileParser.hpp to enable it.\n";
+        return;
+    }
+    static const char* phase_names[] = {"I/O", "tokenize", "convert", "insert"};
+    stream << "Parse phases:\n";
+    for (int phase = 0; phase < 4; phase++)
+        stream << "\t" << phase_names[phase] << ": " << stats.phase_nanoseconds[phase] / 1e6 << " ms\n";
+    stream << "Key reads:\n";
+    for (const KeyCount& read: stats.reads)
+        stream << "\t" << value_type_name(read.type) << " " << read.key << ": " << read.count << "\n";
+    stream << "Misses:\n";
+    for (const KeyCount& miss: stats.misses)
+        stream << "\t" << value_type_name(miss.type) << " " << miss.key << ": " << miss.count << "\n";
+}
+
+
+template<typename T>
+std::size_t NoSweat::NoSweatConfigFileParser::subscribe(const std::string& key, std::function<void(
+    StringRef, typename ValueTraits<T>::result_type, typename ValueTraits<T>::result_type)> callback) {
+    return subscribe<T>(key, false, callback);
+}
+
+
+template<typename T>
+std::size_t NoSweat::NoSweatConfigFileParser::subscribe_prefix(const std::string& prefix, std::function<void(
+    StringRef, typename ValueTraits<T>::result_type, typename ValueTraits<T>::result_type)> callback) {
+    return subscribe<T>(prefix, true, callback);
+}
+
+
+template<typename T>
+std::size_t NoSweat::NoSweatConfigFileParser::subscribe(const std::string& key, bool is_prefix, std::function<void(
+    StringRef, typename ValueTraits<T>::result_type, typename ValueTraits<T>::result_type)> callback) {
+    return notifier_->subscribe(key, is_prefix, ValueTraits<T>::type,
+        [callback](const ConfigEntry& entry, const ConfigValue& old_value, const ConfigValue& new_value) {
+            callback(entry.key, ValueTraits<T>::get(old_value), ValueTraits<T>::get(new_value));
+        });
+}
+
+
+void NoSweat::NoSweatConfigFileParser::unsubscribe(std::size_t id) {
+    notifier_->unsubscribe(id);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::parse_default_config_buffer(const char* data, std::size_t size) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    const std::vector<StringRef> chunks = parse_chunks(data, size);
+    if (chunks.size() > 1) {
+        // Parse the chunks concurrently and add the keys in order.
+        const std::vector<StringRef> sections = chunk_sections(chunks);
+        std::vector<ParsedDefaults> defaults(chunks.size());
+        parallel_for(chunks.size(), parser_threads_, [&](std::size_t i) {
+            parse_default_lines(chunks[i].data(), chunks[i].size(), sections[i], defaults[i]);
+        });
+        add_default_lines(defaults);
+        publish_new_keys();
+        return;
+    }
+    PhaseClock clock{snapshots_->instrumentation()};
+    LineScanner scanner{data, size};
+    StringRef line;
+    std::size_t assignment_index;
+    ConfigLine config_line;
+    StringRef section;
+    // Arrays are converted here before the store copies them.
+    StringStorage arrays;
+    // Loop over all lines.
+    while (scanner.next_statement(line, assignment_index)) {
+        line = trim_line(line, assignment_index);
+        if (section_header(line, section) || !tokenize_default_line(line, assignment_index, config_line))
+            continue;
+        config_line.section = section;
+        clock.lap(Phase::Tokenize);
+        add_default_value(config_line, arrays, clock);
+    }
+    clock.lap(Phase::Tokenize);
+    publish_new_keys();
+}
+
+
+void NoSweat::NoSweatConfigFileParser::publish_new_keys() {
+    snapshots_->publish(new ValueSnapshot(snapshots_->current(), values_));
+    // The new keys may be set by lines that have been ignored before.
+    config_lines_valid_ = false;
+    default_config_hash_valid_ = false;
+}
+
+
+/// All files are mapped and parsed into lines concurrently. Only adding the
+/// keys is done in order, on the calling thread.
+void NoSweat::NoSweatConfigFileParser::parse_default_config_files(const std::vector<std::string>& default_config_files) {
+    // The type keywords and boolean literals the files are parsed with
+    // must not change meanwhile.
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    std::vector<ParsedDefaults> defaults(default_config_files.size());
+    std::vector<char> is_open(default_config_files.size());
+    parallel_for(default_config_files.size(), 0, [&](std::size_t i) {
+        PhaseClock clock{snapshots_->instrumentation()};
+        MappedFile file{default_config_files[i]};
+        clock.lap(Phase::Io);
+        is_open[i] = file.is_open();
+        if (file.is_open())
+            parse_default_lines(file.data(), file.size(), StringRef(), defaults[i]);
+    });
+    for (std::size_t i = 0; i < default_config_files.size(); i++) {
+        if (!is_open[i])
+            std::cout << "WARNING: Could not find the default configuration file " <<
+                default_config_files[i] << "." << std::endl;
+    }
+    add_default_lines(defaults);
+    publish_new_keys();
+}
+
+
+/// The keys are only looked up while parsing, so all files can be parsed
+/// concurrently. The parsed lines are applied in order.
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::read_config_files(const std::vector<std::string>& config_files) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    std::vector<std::unique_ptr<MappedFile>> files(config_files.size());
+    std::vector<std::vector<ParsedLine>> lines(config_files.size());
+    std::vector<StringStorage> arrays(config_files.size());
+    parallel_for(config_files.size(), 0, [&](std::size_t i) {
+        PhaseClock clock{snapshots_->instrumentation()};
+        files[i].reset(new MappedFile(config_files[i]));
+        clock.lap(Phase::Io);
+        if (files[i]->is_open())
+            parse_user_lines(files[i]->data(), files[i]->size(), StringRef(), lines[i], arrays[i]);
+    });
+    const ValueSnapshot& current = snapshots_->current();
+    std::unique_ptr<ValueSnapshot> snapshot{new ValueSnapshot(current, values_)};
+    for (std::size_t i = 0; i < files.size(); i++) {
+        if (!files[i]->is_open())
+            std::cout << "WARNING: Could not find the configuration file " << config_files[i] << "." << std::endl;
+        apply_user_lines(*snapshot, lines[i]);
+    }
+    if (!config_files.empty())
+        config_file_ = config_files.back();
+    set_overrides(*snapshot, overrides_);
+    ChangeSet changes = changed_entries(current, *snapshot);
+    config_lines_valid_ = false;
+    is_default_snapshot_ = false;
+    publish(snapshot.release(), changes);
+    return changes;
+}
+
+
+std::vector<std::string> NoSweat::NoSweatConfigFileParser::config_directory_files(const std::string& directory) {
+    std::vector<std::string> files;
+#ifdef NOSWEAT_HAVE_MMAP
+    DIR* directory_stream = ::opendir(directory.c_str());
+    if (!directory_stream)
+        return files;
+    while (const struct dirent* directory_entry = ::readdir(directory_stream)) {
+        const StringRef name{directory_entry->d_name};
+        if (name.empty() || name[0] == '.')
+            continue;
+        if ((name.size() > 4 && name.substr(name.size() - 4) == ".cfg") ||
+            (name.size() > 5 && name.substr(name.size() - 5) == ".conf"))
+            files.push_back(directory + "/" + name.str());
+    }
+    ::closedir(directory_stream);
+    std::sort(files.begin(), files.end());
+#else
+    (void)directory;
+#endif
+    return files;
+}
+
+
+void NoSweat::NoSweatConfigFileParser::parse_default_lines(const char* data, std::size_t size, StringRef section,
+                                                           ParsedDefaults& defaults) const {
+    PhaseClock clock{snapshots_->instrumentation()};
+    std::vector<ParsedLine>& lines = defaults.lines;
+    LineScanner scanner{data, size};
+    StringRef line;
+    std::size_t assignment_index;
+    ParsedLine parsed_line = ParsedLine();
+    while (scanner.next_statement(line, assignment_index)) {
+        line = trim_line(line, assignment_index);
+        if (section_header(line, section) || !tokenize_default_line(line, assignment_index, parsed_line.line))
+            continue;
+        parsed_line.line.section = section;
+        clock.lap(Phase::Tokenize);
+        // Lines that do not convert are skipped, so later lines can still define the key.
+        parsed_line.value = ConfigValue();
+        if (parsed_line.line.type != ValueType::String) {
+            const bool converted = convert_value(parsed_line.line.type, parsed_line.line.value, parsed_line.value,
+                                                 defaults.arrays);
+            clock.lap(Phase::Convert);
+            if (!converted)
+                continue;
+        }
+        parsed_line.key_hash = hash_key(section, parsed_line.line.key);
+        lines.push_back(parsed_line);
+    }
+    clock.lap(Phase::Tokenize);
+
+    // Copy the keys, as "section.key", and the strings that are too long to be stored inline.
+    std::size_t strings_size = 0;
+    for (const ParsedLine& line: lines) {
+        strings_size += line.line.key.size() + (line.line.section.empty() ? 0 : line.line.section.size() + 1);
+        if (line.line.type == ValueType::String && line.line.value.size() > ConfigValue::inline_capacity)
+            strings_size += line.line.value.size();
+    }
+    defaults.strings.reset(new char[strings_size ? strings_size : 1]);
+    char* strings = defaults.strings.get();
+    for (ParsedLine& line: lines) {
+        if (!line.line.section.empty()) {
+            std::memcpy(strings, line.line.section.data(), line.line.section.size());
+            line.line.section = StringRef(strings, line.line.section.size());
+            strings += line.line.section.size();
+            *strings++ = '.';
+        }
+        std::memcpy(strings, line.line.key.data(), line.line.key.size());
+        line.line.key = StringRef(strings, line.line.key.size());
+        strings += line.line.key.size();
+        if (line.line.type != ValueType::String)
+            continue;
+        line.value.string_size = line.line.value.size();
+        if (line.line.value.size() <= ConfigValue::inline_capacity) {
+            std::memcpy(line.value.inline_string, line.line.value.data(), line.line.value.size());
+        }
+        else {
+            std::memcpy(strings, line.line.value.data(), line.line.value.size());
+            line.value.external_string = strings;
+            strings += line.line.value.size();
+        }
+    }
+    clock.lap(Phase::Insert);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::parse_user_lines(const char* data, std::size_t size, StringRef section_name,
+                                                        std::vector<ParsedLine>& lines, StringStorage& arrays,
+                                                        std::vector<LineRecord>* records) const {
+    PhaseClock clock{snapshots_->instrumentation()};
+    LineScanner scanner{data, size};
+    StringRef line;
+    std::size_t assignment_index;
+    UserSection section = user_section(section_name);
+    ParsedLine parsed_line = ParsedLine();
+    while (scanner.next_statement(line, assignment_index)) {
+        line = trim_line(line, assignment_index);
+        if (section_header(line, section_name)) {
+            section = user_section(section_name);
+            if (records)
+                records->push_back(LineRecord{hash_key(line), UINT32_MAX});
+            continue;
+        }
+        parsed_line.entry = resolve_user_line(line, assignment_index, section, parsed_line.line, parsed_line.value,
+                                              arrays, clock);
+        if (parsed_line.entry)
+            lines.push_back(parsed_line);
+        if (records) {
+            records->push_back(LineRecord{hash_key(section.name, line),
+                                          parsed_line.entry ? parsed_line.entry->id : UINT32_MAX});
+        }
+    }
+    clock.lap(Phase::Tokenize);
+}
+
+
+namespace NoSweat {
+    // True if the text ends with a comma, ignoring trailing whitespace.
+    inline bool ends_with_comma(StringRef text) {
+        const char* end = text.end();
+        while (end > text.begin() && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+            end--;
+        return end > text.begin() && end[-1] == ',';
+    }
+}
+
+
+/// Chunks are at least a megabyte and there are a few per thread, so
+/// uneven chunks are balanced.
+std::vector<NoSweat::StringRef> NoSweat::NoSweatConfigFileParser::parse_chunks(const char* data,
+                                                                               std::size_t size) const {
+    const std::size_t min_chunk_size = 1 << 20;
+    const unsigned threads = parser_threads_ ? parser_threads_ : std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t chunk_count = std::min<std::size_t>(4 * threads, size / min_chunk_size);
+    std::vector<StringRef> chunks;
+    if (threads == 1 || chunk_count < 2) {
+        chunks.push_back(StringRef(data, size));
+        return chunks;
+    }
+    const char* end = data + size;
+    const char* chunk_begin = data;
+    for (std::size_t i = 1; i < chunk_count && chunk_begin < end; i++) {
+        const char* split = std::max(chunk_begin, data + i * (size / chunk_count));
+        const char* newline = static_cast<const char*>(std::memchr(split, '\n', end - split));
+        // Never split statements continued after a comma.
+        while (newline && ends_with_comma(StringRef(chunk_begin, newline - chunk_begin)))
+            newline = static_cast<const char*>(std::memchr(newline + 1, '\n', end - newline - 1));
+        if (!newline)
+            break;
+        chunks.push_back(StringRef(chunk_begin, newline + 1 - chunk_begin));
+        chunk_begin = newline + 1;
+    }
+    if (chunk_begin < end)
+        chunks.push_back(StringRef(chunk_begin, end - chunk_begin));
+    return chunks;
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_lines(std::vector<ParsedDefaults>& defaults) {
+    PhaseClock clock{snapshots_->instrumentation()};
+    std::size_t line_count = values_.size();
+    for (const ParsedDefaults& parsed: defaults)
+        line_count += parsed.lines.size();
+    values_.reserve(line_count);
+    for (ParsedDefaults& parsed: defaults) {
+        // Fetch the slots of the following keys while inserting. Does
+        // nothing for keys that have been taken before.
+        const std::size_t prefetch_distance = 8;
+        for (std::size_t i = 0; i < parsed.lines.size(); i++) {
+            if (i + prefetch_distance < parsed.lines.size())
+                values_.prefetch(parsed.lines[i + prefetch_distance].key_hash);
+            const ParsedLine& line = parsed.lines[i];
+            const ConfigLine& config_line = line.line;
+            const std::uint32_t section_size = static_cast<std::uint32_t>(config_line.section.size());
+            values_.insert_external(StringRef(config_line.key.data() - (section_size ? section_size + 1 : 0),
+                                              config_line.key.size() + (section_size ? section_size + 1 : 0)),
+                                    section_size, line.key_hash, config_line.type, line.value);
+        }
+        values_.adopt_strings(std::move(parsed.strings));
+        values_.adopt_strings(std::move(parsed.arrays));
+    }
+    clock.lap(Phase::Insert);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::apply_user_lines(ValueSnapshot& snapshot,
+                                                        const std::vector<ParsedLine>& lines) const {
+    PhaseClock clock{snapshots_->instrumentation()};
+    for (const ParsedLine& line: lines)
+        set_value(snapshot, *line.entry, line.line, line.value);
+    clock.lap(Phase::Insert);
+}
+
+
+/// The new values are built in a separate snapshot and become visible all at once.
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::read_config_buffer(const char* data, std::size_t size) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    const ValueSnapshot& current = snapshots_->current();
+    std::unique_ptr<ValueSnapshot> snapshot{new ValueSnapshot(current, values_)};
+    apply_config_buffer(*snapshot, data, size);
+    set_overrides(*snapshot, overrides_);
+    ChangeSet changes = changed_entries(current, *snapshot);
+    config_lines_valid_ = false;
+    is_default_snapshot_ = false;
+    publish(snapshot.release(), changes);
+    return changes;
+}
+
+
+/// Overrides are resolved and converted once to drop invalid ones, and then
+/// converted again whenever they are set on top of a configuration read.
+NoSweat::ChangeSet NoSweat::NoSweatConfigFileParser::apply_overrides(int argc, const char* const* argv,
+                                                                     const std::string& environment_prefix) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    std::vector<Override> overrides;
+    Override resolved;
+#ifdef NOSWEAT_HAVE_MMAP
+    for (char** variable = environ; !environment_prefix.empty() && variable && *variable; variable++) {
+        const StringRef assignment{*variable};
+        if (assignment.starts_with(environment_prefix) &&
+            resolve_environment_variable(assignment.substr(environment_prefix.size()), resolved))
+            overrides.push_back(resolved);
+    }
+#else
+    (void)environment_prefix;
+#endif
+    PhaseClock clock{snapshots_->instrumentation()};
+    StringStorage arrays;
+    const StringRef set_option{"--set"};
+    for (int i = 1; i < argc; i++) {
+        StringRef argument{argv[i]};
+        if (argument == set_option && i + 1 < argc)
+            argument = StringRef(argv[++i]);
+        else if (argument.starts_with("--set="))
+            argument = argument.substr(set_option.size() + 1);
+        else
+            continue;
+        std::size_t assignment_index = argument.find_first_of(assignment_operators);
+        const StringRef line = trim_line(argument, assignment_index);
+        ConfigLine config_line;
+        ConfigValue value = ConfigValue();
+        const ConfigEntry* entry = resolve_user_line(line, assignment_index, UserSection{StringRef(), false},
+                                                     config_line, value, arrays, clock);
+        if (entry)
+            overrides.push_back(Override{entry->id, config_line.value});
+    }
+
+    const ValueSnapshot& current = snapshots_->current();
+    std::unique_ptr<ValueSnapshot> snapshot{new ValueSnapshot(current, values_)};
+    set_overrides(*snapshot, overrides);
+    overrides_.insert(overrides_.end(), overrides.begin(), overrides.end());
+    ChangeSet changes = changed_entries(current, *snapshot);
+    if (!overrides.empty())
+        is_default_snapshot_ = false;
+    publish(snapshot.release(), changes);
+    return changes;
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::resolve_environment_variable(StringRef variable, Override& resolved) const {
+    const std::size_t equals = variable.find_first_of("=");
+    if (equals == std::string::npos)
+        return false;
+    const StringRef name = variable.substr(0, equals);
+    const ConfigEntry* entry = values_.find(name);
+    if (!entry) {
+        std::string key;
+        key.reserve(name.size());
+        for (std::size_t i = 0; i < name.size(); i++) {
+            if (name[i] == '_' && i + 1 < name.size() && name[i + 1] == '_') {
+                key += '.';
+                i++;
+            }
+            else {
+                key += static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
+            }
+        }
+        entry = values_.find(key);
+    }
+    if (!entry)
+        return false;
+    StringRef value = variable.substr(equals + 1).trimmed();
+    if (!array_element_size(entry->type))
+        value = first_line(value);
+    // Like a line without a value in a configuration file.
+    if (value.empty())
+        return false;
+    ConfigValue converted = ConfigValue();
+    StringStorage arrays;
+    if (entry->type != ValueType::String && !convert_value(entry->type, value, converted, arrays))
+        return false;
+    resolved = Override{entry->id, value};
+    return true;
+}
+
+
+void NoSweat::NoSweatConfigFileParser::set_overrides(ValueSnapshot& snapshot,
+                                                     const std::vector<Override>& overrides) const {
+    StringStorage arrays;
+    for (const Override& override_value: overrides) {
+        const ConfigEntry& entry = values_.entry(override_value.id);
+        ConfigLine config_line = ConfigLine();
+        config_line.value = override_value.value;
+        ConfigValue value = ConfigValue();
+        if (entry.type == ValueType::String || convert_value(entry.type, override_value.value, value, arrays))
+            set_value(snapshot, entry, config_line, value);
+    }
+}
+
+
+void NoSweat::NoSweatConfigFileParser::apply_config_buffer(ValueSnapshot& snapshot, const char* data,
+                                                           std::size_t size, std::vector<LineRecord>* records) {
+    const std::vector<StringRef> chunks = parse_chunks(data, size);
+    if (chunks.size() > 1) {
+        // Parse the chunks concurrently and apply the values in order.
+        const std::vector<StringRef> sections = chunk_sections(chunks);
+        std::vector<std::vector<ParsedLine>> lines(chunks.size());
+        std::vector<StringStorage> arrays(chunks.size());
+        std::vector<std::vector<LineRecord>> chunk_records(chunks.size());
+        parallel_for(chunks.size(), parser_threads_, [&](std::size_t i) {
+            parse_user_lines(chunks[i].data(), chunks[i].size(), sections[i], lines[i], arrays[i],
+                             records ? &chunk_records[i] : nullptr);
+        });
+        for (std::size_t i = 0; i < chunks.size(); i++) {
+            apply_user_lines(snapshot, lines[i]);
+            if (records)
+                records->insert(records->end(), chunk_records[i].begin(), chunk_records[i].end());
+        }
+        return;
+    }
+    PhaseClock clock{snapshots_->instrumentation()};
+    LineScanner scanner{data, size};
+    StringRef line;
+    std::size_t assignment_index;
+    ConfigLine config_line;
+    ConfigValue value;
+    StringStorage arrays;
+    StringRef section_name;
+    UserSection section = user_section(section_name);
+    // Loop over all lines.
+    while (scanner.next_statement(line, assignment_index)) {
+        line = trim_line(line, assignment_index);
+        if (section_header(line, section_name)) {
+            section = user_section(section_name);
+            if (records)
+                records->push_back(LineRecord{hash_key(line), UINT32_MAX});
+            continue;
+        }
+        const ConfigEntry* entry = resolve_user_line(line, assignment_index, section, config_line, value, arrays,
+                                                     clock);
+        if (entry) {
+            set_value(snapshot, *entry, config_line, value);
+            clock.lap(Phase::Insert);
+        }
+        if (records)
+            records->push_back(LineRecord{hash_key(section.name, line), entry ? entry->id : UINT32_MAX});
+    }
+    clock.lap(Phase::Tokenize);
+}
+
+
+NoSweat::ValueType NoSweat::NoSweatConfigFileParser::leading_value_type(const LiteralTable& type_keywords,
+                                                                       StringRef line) {
+    // Only the first few characters can be a keyword.
+    const char* space = static_cast<const char*>(
+        std::memchr(line.data(), ' ', std::min(line.size(), LiteralTable::max_literal_size + 1)));
+    if (!space)
+        return ValueType::Unknown;
+    const int type = type_keywords.find(StringRef(line.data(), space - line.data()));
+    return type < 0 ? ValueType::Unknown : static_cast<ValueType>(type);
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::section_header(StringRef line, StringRef& section) {
+    // Not "[type] key = [value]".
+    if (line.size() < 2 || line[0] != '[' || line.find_first_of("]") != line.size() - 1)
+        return false;
+    section = line.substr(1, line.size() - 2).trimmed();
+    return true;
+}
+
+
+/// The last header of every chunk is searched concurrently. Each chunk
+/// starts in the section of the last header of the chunks before.
+std::vector<NoSweat::StringRef> NoSweat::NoSweatConfigFileParser::chunk_sections(
+        const std::vector<StringRef>& chunks) const {
+    std::vector<StringRef> last_headers(chunks.size());
+    std::vector<char> has_header(chunks.size());
+    parallel_for(chunks.size() - 1, parser_threads_, [&](std::size_t i) {
+        has_header[i] = last_section_header(chunks[i], last_headers[i]);
+    });
+    std::vector<StringRef> sections(chunks.size());
+    for (std::size_t i = 1; i < chunks.size(); i++)
+        sections[i] = has_header[i - 1] ? last_headers[i - 1] : sections[i - 1];
+    return sections;
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::last_section_header(StringRef text, StringRef& section) {
+    std::size_t line_end = text.size();
+    for (std::size_t i = text.size(); i-- > 0; ) {
+        if (text[i] != '\n' && i > 0)
+            continue;
+        const std::size_t line_begin = text[i] == '\n' ? i + 1 : 0;
+        if (section_header(text.substr(line_begin, line_end - line_begin).trimmed(), section))
+            return true;
+        line_end = i;
+    }
+    return false;
+}
+
+
+/// Default configuration lines need to have the form "type key = value".
+bool NoSweat::NoSweatConfigFileParser::tokenize_default_line(StringRef line, std::size_t assignment_index,
+                                                             ConfigLine& config_line) const {
+    // Check if the trimmed line starts with a value keyword.
+    config_line.type = leading_value_type(value_type_keywords_, line);
+    if (config_line.type == ValueType::Unknown)
+        return false;
+
+    // Split at the first equals sign, or colon, if it has none, skip the line.
+    std::size_t index = assignment_index;
+    // If it either has none of these symbol or the first occurence is at the end, skip the line.
+    if (index == std::string::npos || index == (line.size() - 1))
+        return false;
+    // Otherwise split it in two parts.
+    StringRef type_and_key = line.substr(0, index).trimmed();
+    config_line.value = line.substr(index + 1).trimmed();
+    if (!array_element_size(config_line.type))
+        config_line.value = first_line(config_line.value);
+    if (type_and_key.empty() || config_line.value.empty())
+        return false;
+
+    // The key follows the first space. Without one, e.g. for "int = 1", the
+    // whole remainder is used as the key.
+    index = type_and_key.find_first_of(" ");
+    config_line.key = type_and_key.substr(index == std::string::npos ? 0 : index + 1).trimmed();
+    return true;
+}
+
+
+/// User configuration lines need to have the form "[type] key = value".
+bool NoSweat::NoSweatConfigFileParser::tokenize_user_line(const LiteralTable& type_keywords, StringRef line,
+                                                          std::size_t assignment_index, ConfigLine& config_line) {
+    std::size_t index = assignment_index;
+    if (index == std::string::npos || index == 0 || index == (line.size() - 1))
+        return false;
+
+    config_line.key = line.substr(0, index).trimmed();
+    config_line.value = line.substr(index + 1).trimmed();
+
+    config_line.type = leading_value_type(type_keywords, line);
+    if (config_line.type != ValueType::Unknown) {
+        // Strip the type keyword from the key.
+        index = config_line.key.find_first_of(" \t");
+        config_line.key = index == std::string::npos ? StringRef() : config_line.key.substr(index).trimmed();
+    }
+    return true;
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(const ConfigLine& config_line, StringStorage& arrays,
+                                                         PhaseClock& clock) {
+    ConfigValue default_value = ConfigValue();
+    if (config_line.type != ValueType::String) {
+        const bool converted = convert_value(config_line.type, config_line.value, default_value, arrays);
+        clock.lap(Phase::Convert);
+        if (!converted)
+            return;
+    }
+    // Does nothing if the key has been taken before.
+    values_.insert(config_line.section, config_line.key, hash_key(config_line.section, config_line.key),
+                   config_line.type, default_value, config_line.value);
+    clock.lap(Phase::Insert);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(StringRef key, int value) {
+    ConfigValue default_value = ConfigValue();
+    default_value.integer = value;
+    values_.insert(key, ValueType::Integer, default_value);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(StringRef key, float value) {
+    ConfigValue default_value = ConfigValue();
+    default_value.floating = value;
+    values_.insert(key, ValueType::Float, default_value);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(StringRef key, bool value) {
+    ConfigValue default_value = ConfigValue();
+    default_value.boolean = value;
+    values_.insert(key, ValueType::Bool, default_value);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(StringRef key, std::int64_t value) {
+    ConfigValue default_value = ConfigValue();
+    default_value.integer64 = value;
+    values_.insert(key, ValueType::Integer64, default_value);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(StringRef key, double value) {
+    ConfigValue default_value = ConfigValue();
+    default_value.floating64 = value;
+    values_.insert(key, ValueType::Double, default_value);
+}
+
+
+void NoSweat::NoSweatConfigFileParser::add_default_value(StringRef key, const std::string& value) {
+    values_.insert(key, ValueType::String, ConfigValue(), value);
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::convert_value(ValueType type, StringRef str, ConfigValue& value,
+                                                     StringStorage& arrays) const {
+    value.string_size = 0;
+    switch (type) {
+        case ValueType::Integer:
+            return convert_to_int(str, value.integer);
+        case ValueType::Float:
+            return convert_to_float(str, value.floating);
+        case ValueType::Bool:
+            return convert_to_bool(str, value.boolean);
+        case ValueType::Integer64:
+            return convert_to_int64(str, value.integer64);
+        case ValueType::Double:
+            return convert_to_double(str, value.floating64);
+        case ValueType::IntegerArray:
+        case ValueType::FloatArray:
+        case ValueType::Integer64Array:
+        case ValueType::DoubleArray:
+            return convert_to_array(type, str, value, arrays);
+        default:
+            return false;
+    }
+}
+
+
+/// Lines of the last read configuration file that have been rejected
+/// before may be accepted now, so they are all parsed again on the next read.
+bool NoSweat::NoSweatConfigFileParser::add_boolean_literal(const std::string& literal, bool value) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    config_lines_valid_ = false;
+    return boolean_literals_.add(literal, value);
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::add_type_keyword(const std::string& keyword, ValueType type) {
+    if (type == ValueType::Unknown || keyword.find_first_of(" \t") != std::string::npos)
+        return false;
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    config_lines_valid_ = false;
+    return value_type_keywords_.add(keyword, static_cast<int>(type));
+}
+
+
+/// Map a case-insensitive boolean name to its value. Return false if the
+/// name is not an accepted boolean value.
+bool NoSweat::NoSweatConfigFileParser::convert_to_bool(StringRef str, bool& value) const {
+    const int literal_value = boolean_literals_.find(str);
+    if (literal_value < 0)
+        return false;
+    value = literal_value != 0;
+    return true;
+}
+
+
+/// Returns true if the key has not been taken yet.
+bool NoSweat::NoSweatConfigFileParser::is_key_available(StringRef key) const {
+    return values_.find(key) == nullptr;
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::NoSweatConfigFileParser::resolve_user_line(StringRef line,
+                                                                                std::size_t assignment_index,
+                                                                                const UserSection& section,
+                                                                                ConfigLine& config_line,
+                                                                                ConfigValue& value,
+                                                                                StringStorage& arrays,
+                                                                                PhaseClock& clock) const {
+    if (!tokenize_user_line(value_type_keywords_, line, assignment_index, config_line))
+        return nullptr;
+    config_line.section = section.name;
+    const ConfigEntry* entry = nullptr;
+    if (!section.name.empty())
+        entry = values_.find(section.name, config_line.key, hash_key(section.name, config_line.key));
+    if (!entry && !section.is_known)
+        entry = values_.find(config_line.key);
+    // If the type is given in the user configuration file it will be
+    // enforced, e.g. it will not be accepted as a value for a key with
+    // the same name but a different type.
+    if (!entry || (config_line.type != ValueType::Unknown && config_line.type != entry->type))
+        return nullptr;
+    clock.lap(Phase::Tokenize);
+    if (!array_element_size(entry->type))
+        config_line.value = first_line(config_line.value);
+    if (entry->type != ValueType::String) {
+        const bool converted = convert_value(entry->type, config_line.value, value, arrays);
+        clock.lap(Phase::Convert);
+        if (!converted)
+            return nullptr;
+    }
+    return entry;
+}
+
+
+void NoSweat::NoSweatConfigFileParser::set_value(ValueSnapshot& snapshot, const ConfigEntry& entry,
+                                                 const ConfigLine& config_line, const ConfigValue& value) const {
+    if (entry.type == ValueType::String)
+        snapshot.set_string(entry, config_line.value);
+    else if (array_element_size(entry.type))
+        snapshot.set_array(entry, value);
+    else
+        snapshot.set(entry, value);
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::NoSweatConfigFileParser::find_entry(StringRef key, ValueType type) const {
+    const ConfigEntry* entry = values_.find(key);
+    if (!entry || entry->type != type) {
+        snapshots_->instrumentation().record_miss(key, type);
+        return nullptr;
+    }
+    return entry;
+}
+
+
+/// Two-sided in-place whitespace trimming.
+inline void NoSweat::trim(std::string& str) {
+    // Define all needed whitespaces: space, horizontal tab, new line, carriage return, vertical tab and line feed.
+    std::string whitespace_chars{" \t\n\r\v\f"};
+    // Remove leading spaces.
+    str.erase(0, str.find_first_not_of(whitespace_chars));
+    // Remove trailing spaces.
+    str.erase(str.find_last_not_of(whitespace_chars) + 1);
+}
+
+
+/// Return true, if str starts with substr, false otherwise.
+inline bool NoSweat::starts_with(const std::string str, const std::string substr) {
+    std::string::size_type length = substr.size();
+    if (length == 0) {
+        // Obviously always true.
+        return true;
+    }
+    if (str.substr(0, length) == substr)
+        return true;
+    return false;
+}
+
+
+NoSweat::StringRef NoSweat::first_line(StringRef value) {
+    const char* newline = static_cast<const char*>(std::memchr(value.data(), '\n', value.size()));
+    return newline ? StringRef(value.data(), newline - value.data()).trimmed() : value;
+}
+
+
+bool NoSweat::is_comment(StringRef trimmed_line) {
+    return !trimmed_line.empty() && (trimmed_line[0] == '#' || trimmed_line[0] == ';');
+}
+
+
+NoSweat::StringRef NoSweat::trim_line(StringRef line, std::size_t& assignment_index) {
+    StringRef trimmed_line = line.trimmed();
+    // Assignment operators are no whitespace and thus always part of the trimmed line.
+    if (assignment_index != std::string::npos)
+        assignment_index -= trimmed_line.data() - line.data();
+    return trimmed_line;
+}
+
+
+bool NoSweat::parse_decimal_integer(StringRef str, bool& negative, std::uint64_t& magnitude) {
+    std::size_t i = 0;
+    negative = false;
+    if (i < str.size() && (str[i] == '+' || str[i] == '-'))
+        negative = str[i++] == '-';
+    if (i == str.size())
+        return false;
+    magnitude = 0;
+    // Eight digits at a time, as long as they cannot overflow.
+    std::uint32_t eight_digits;
+    while (i + 8 <= str.size() && magnitude < 100000000000ULL && parse_eight_digits(str.data() + i, eight_digits)) {
+        magnitude = magnitude * 100000000 + eight_digits;
+        i += 8;
+    }
+    for (; i < str.size(); i++) {
+        const unsigned digit = static_cast<unsigned char>(str[i]) - '0';
+        if (digit > 9 || magnitude > (UINT64_MAX - digit) / 10)
+            return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    return true;
+}
+
+
+/// Subtracts '0' from all eight bytes at once and combines the digits
+/// pairwise in three multiplications (SWAR, as in simdjson and fast_float).
+/// Falls back to nothing on big-endian machines, where the byte order of the
+/// loaded word is reversed.
+bool NoSweat::parse_eight_digits(const char* digits, std::uint32_t& value) {
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+    std::uint64_t block;
+    std::memcpy(&block, digits, sizeof(block));
+    // Digits are 0x30 to 0x39: the high nibble is 3 and adding 6 does not carry.
+    if (((block & 0xF0F0F0F0F0F0F0F0ULL) | (((block + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+        0x3333333333333333ULL)
+        return false;
+    block -= 0x3030303030303030ULL;
+    block = block * 10 + (block >> 8);
+    block = (((block & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+             (((block >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    value = static_cast<std::uint32_t>(block);
+    return true;
+#else
+    (void)digits;
+    (void)value;
+    return false;
+#endif
+}
+
+
+bool NoSweat::convert_to_int(StringRef str, int& value) {
+    std::int64_t long_value;
+    if (!convert_to_int64(str, long_value) || long_value < INT_MIN || long_value > INT_MAX)
+        return false;
+    value = static_cast<int>(long_value);
+    return true;
+}
+
+
+bool NoSweat::convert_to_int64(StringRef str, std::int64_t& value) {
+    bool negative;
+    std::uint64_t magnitude;
+    if (!parse_decimal_integer(str, negative, magnitude) || magnitude > std::uint64_t(INT64_MAX) + negative)
+        return false;
+    // The magnitude of INT64_MIN does not fit into an std::int64_t.
+    if (negative && magnitude)
+        value = -static_cast<std::int64_t>(magnitude - 1) - 1;
+    else
+        value = static_cast<std::int64_t>(magnitude);
+    return true;
+}
+
+
+bool NoSweat::convert_to_float(StringRef str, float& value) {
+    return convert_to_floating_point(str, value);
+}
+
+
+bool NoSweat::convert_to_double(StringRef str, double& value) {
+    return convert_to_floating_point(str, value);
+}
+
+
+namespace NoSweat {
+    // Largest mantissas and powers of ten that are exactly representable.
+    template<typename T>
+    struct ExactFloatingPoint;
+    template<>
+    struct ExactFloatingPoint<float> {
+        static const std::uint64_t max_mantissa = std::uint64_t(1) << 24;
+        static const int max_power = 10;
+        static float power_of_ten(int power) {
+            static const float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+            return powers[power];
+        }
+    };
+    template<>
+    struct ExactFloatingPoint<double> {
+        static const std::uint64_t max_mantissa = std::uint64_t(1) << 53;
+        static const int max_power = 22;
+        static double power_of_ten(int power) {
+            static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+                                            1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+            return powers[power];
+        }
+    };
+}
+
+
+/// Accepts [+-]digits[.digits][(e|E)[+-]digits] with at least one digit in
+/// the mantissa. If the mantissa and the power of ten are both exactly
+/// representable, a single multiplication or division gives the correctly
+/// rounded result (Clinger's fast path), which covers almost all
+/// configuration values. Other numbers are converted by the standard
+/// library with the classic locale, with the same result.
+template<typename T>
+bool NoSweat::convert_to_floating_point(StringRef str, T& value) {
+    std::size_t i = 0;
+    const bool negative = i < str.size() && str[i] == '-';
+    if (i < str.size() && (str[i] == '+' || str[i] == '-'))
+        i++;
+    std::uint64_t mantissa = 0;
+    int significant_digits = 0;
+    int exponent = 0;
+    bool has_digits = false;
+    bool seen_point = false;
+    bool exact = true;
+    for (; i < str.size(); i++) {
+        // Eight significant digits at a time, as long as they fit.
+        std::uint32_t eight_digits;
+        if (mantissa && significant_digits <= 11 && i + 8 <= str.size() &&
+            parse_eight_digits(str.data() + i, eight_digits)) {
+            mantissa = mantissa * 100000000 + eight_digits;
+            significant_digits += 8;
+            if (seen_point)
+                exponent -= 8;
+            i += 7;
+            continue;
+        }
+        const unsigned digit = static_cast<unsigned char>(str[i]) - '0';
+        if (digit <= 9) {
+            has_digits = true;
+            if (mantissa || digit)
+                significant_digits++;
+            if (significant_digits <= 19) {
+                mantissa = mantissa * 10 + digit;
+                if (seen_point)
+                    exponent--;
+            }
+            else {
+                // Digits beyond the 64 bits of the mantissa.
+                exact = exact && digit == 0;
+                if (!seen_point)
+                    exponent++;
+            }
+        }
+        else if (str[i] == '.' && !seen_point) {
+            seen_point = true;
+        }
+        else {
+            break;
+        }
+    }
+    if (!has_digits)
+        return false;
+    if (i < str.size()) {
+        if (str[i] != 'e' && str[i] != 'E')
+            return false;
+        bool exponent_negative;
+        std::uint64_t exponent_magnitude;
+        if (!parse_decimal_integer(str.substr(i + 1), exponent_negative, exponent_magnitude))
+            return false;
+        // Beyond the range of any type, but without overflowing.
+        const int clamped_magnitude = static_cast<int>(std::min<std::uint64_t>(exponent_magnitude, 100000));
+        exponent += exponent_negative ? -clamped_magnitude : clamped_magnitude;
+    }
+
+    typedef ExactFloatingPoint<T> Exact;
+    if (exact && mantissa <= Exact::max_mantissa && exponent >= -Exact::max_power && exponent <= Exact::max_power) {
+        T result = static_cast<T>(mantissa);
+        if (exponent < 0)
+            result /= Exact::power_of_ten(-exponent);
+        else
+            result *= Exact::power_of_ten(exponent);
+        value = negative ? -result : result;
+        return true;
+    }
+    std::istringstream stream{str.str()};
+    stream.imbue(std::locale::classic());
+    T result = T();
+    stream >> result;
+    if (stream.fail())
+        return false;
+    value = result;
+    return true;
+}
+
+
+/// Tasks are handed out one at a time, so uneven tasks are balanced. The
+/// threads are started per call; a call parses whole files or chunks of
+/// at least a megabyte, which outweighs starting a thread.
+template<typename Task>
+void NoSweat::parallel_for(std::size_t count, unsigned max_threads, Task task) {
+    if (!max_threads)
+        max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t thread_count = std::min<std::size_t>(count, max_threads);
+    std::atomic<std::size_t> next_task{0};
+    auto work = [&]() {
+        for (std::size_t i = next_task++; i < count; i = next_task++)
+            task(i);
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < thread_count; i++)
+        threads.emplace_back(work);
+    work();
+    for (std::thread& thread: threads)
+        thread.join();
+}
+
+
+const char* NoSweat::value_type_name(ValueType type) {
+    switch (type) {
+        case ValueType::Integer: return "int";
+        case ValueType::Float: return "float";
+        case ValueType::String: return "string";
+        case ValueType::Bool: return "bool";
+        case ValueType::Integer64: return "int64";
+        case ValueType::Double: return "double";
+        case ValueType::IntegerArray: return "int[]";
+        case ValueType::FloatArray: return "float[]";
+        case ValueType::Integer64Array: return "int64[]";
+        case ValueType::DoubleArray: return "double[]";
+        default: return "unknown";
+    }
+}
+
+
+std::size_t NoSweat::array_element_size(ValueType type) {
+    switch (type) {
+        case ValueType::IntegerArray: return sizeof(int);
+        case ValueType::FloatArray: return sizeof(float);
+        case ValueType::Integer64Array: return sizeof(std::int64_t);
+        case ValueType::DoubleArray: return sizeof(double);
+        default: return 0;
+    }
+}
+
+
+bool NoSweat::convert_to_array(ValueType type, StringRef str, ConfigValue& value, StringStorage& arrays) {
+    switch (type) {
+        case ValueType::IntegerArray:
+            return convert_elements<int>(str, value, arrays, convert_to_int);
+        case ValueType::FloatArray:
+            return convert_elements<float>(str, value, arrays, convert_to_float);
+        case ValueType::Integer64Array:
+            return convert_elements<std::int64_t>(str, value, arrays, convert_to_int64);
+        case ValueType::DoubleArray:
+            return convert_elements<double>(str, value, arrays, convert_to_double);
+        default:
+            return false;
+    }
+}
+
+
+/// The elements are converted in a single pass straight into their final
+/// place: the commas are counted first, so the storage is allocated once.
+/// If an element does not convert, the storage is left unused.
+template<typename T, typename Convert>
+bool NoSweat::convert_elements(StringRef str, ConfigValue& value, StringStorage& arrays, Convert convert) {
+    const std::size_t capacity = std::count(str.begin(), str.end(), ',') + 1;
+    if (capacity > UINT32_MAX)
+        return false;
+    T* elements = reinterpret_cast<T*>(arrays.allocate_array(capacity * sizeof(T)));
+    std::uint32_t count = 0;
+    const char* element_begin = str.begin();
+    while (element_begin < str.end()) {
+        const char* comma = static_cast<const char*>(std::memchr(element_begin, ',', str.end() - element_begin));
+        const char* element_end = comma ? comma : str.end();
+        const StringRef element = StringRef(element_begin, element_end - element_begin).trimmed();
+        // Only the last element may be empty, after a trailing comma.
+        if (element.empty() ? comma || count == 0 : !convert(element, elements[count++]))
+            return false;
+        element_begin = element_end + 1;
+    }
+    if (count == 0)
+        return false;
+    value.external_array = elements;
+    value.string_size = count;
+    return true;
+}
+
+
+/// Floats are compared bitwise, so a NaN equals itself.
+bool NoSweat::values_equal(ValueType type, const ConfigValue& lhs, const ConfigValue& rhs) {
+    switch (type) {
+        case ValueType::Integer:
+            return lhs.integer == rhs.integer;
+        case ValueType::Float:
+            return std::memcmp(&lhs.floating, &rhs.floating, sizeof(float)) == 0;
+        case ValueType::String:
+            return lhs.string() == rhs.string();
+        case ValueType::Bool:
+            return lhs.boolean == rhs.boolean;
+        case ValueType::Integer64:
+            return lhs.integer64 == rhs.integer64;
+        case ValueType::Double:
+            return std::memcmp(&lhs.floating64, &rhs.floating64, sizeof(double)) == 0;
+        case ValueType::IntegerArray:
+        case ValueType::FloatArray:
+        case ValueType::Integer64Array:
+        case ValueType::DoubleArray:
+            return lhs.string_size == rhs.string_size && (lhs.external_array == rhs.external_array ||
+                std::memcmp(lhs.external_array, rhs.external_array, lhs.string_size * array_element_size(type)) == 0);
+        default:
+            return true;
+    }
+}
+
+
+void NoSweat::append_integer(std::string& output, std::int64_t value) {
+    char digits[20];
+    char* begin = digits + sizeof(digits);
+    std::uint64_t magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+    do {
+        *--begin = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0)
+        output += '-';
+    output.append(begin, digits + sizeof(digits));
+}
+
+
+/// Tries increasing precisions, starting with the one every decimal number
+/// of that many digits survives, so e.g. 0.1f is written as 0.1 and not as
+/// 0.100000001. The decimal point of the current locale is replaced.
+template<typename T>
+void NoSweat::append_floating_point(std::string& output, T value) {
+    if (!std::isfinite(value)) {
+        output += std::isnan(value) ? "nan" : (value < 0 ? "-inf" : "inf");
+        return;
+    }
+    const char decimal_point = *std::localeconv()->decimal_point;
+    char digits[32];
+    int size = 0;
+    for (int precision = std::numeric_limits<T>::digits10; precision <= std::numeric_limits<T>::max_digits10;
+         precision++) {
+        size = std::snprintf(digits, sizeof(digits), "%.*g", precision, static_cast<double>(value));
+        if (decimal_point != '.')
+            std::replace(digits, digits + size, decimal_point, '.');
+        T converted;
+        if (convert_to_floating_point(StringRef(digits, size), converted) &&
+            std::memcmp(&converted, &value, sizeof(T)) == 0)
+            break;
+    }
+    output.append(digits, size);
+}
+
+
+void NoSweat::append_value(std::string& output, ValueType type, const ConfigValue& value, EmitFormat format) {
+    // JSON has no representation of infinity and NaN.
+    auto append_number = [&](double number, bool is_float) {
+        if (format == EmitFormat::Json && !std::isfinite(number))
+            output += "null";
+        else if (is_float)
+            append_floating_point(output, static_cast<float>(number));
+        else
+            append_floating_point(output, number);
+    };
+    const std::size_t element_size = array_element_size(type);
+    if (element_size) {
+        output += format == EmitFormat::Json ? "[" : "";
+        for (std::uint32_t i = 0; i < value.string_size; i++) {
+            if (i)
+                output += ", ";
+            switch (type) {
+                case ValueType::IntegerArray: append_integer(output, value.array<int>()[i]); break;
+                case ValueType::FloatArray: append_number(value.array<float>()[i], true); break;
+                case ValueType::Integer64Array: append_integer(output, value.array<std::int64_t>()[i]); break;
+                default: append_number(value.array<double>()[i], false); break;
+            }
+        }
+        output += format == EmitFormat::Json ? "]" : "";
+        return;
+    }
+    switch (type) {
+        case ValueType::Integer: append_integer(output, value.integer); break;
+        case ValueType::Float: append_number(value.floating, true); break;
+        case ValueType::Integer64: append_integer(output, value.integer64); break;
+        case ValueType::Double: append_number(value.floating64, false); break;
+        case ValueType::Bool: output += value.boolean ? "true" : "false"; break;
+        case ValueType::String:
+            if (format == EmitFormat::Json)
+                append_json_string(output, value.string());
+            else
+                output.append(value.string().data(), value.string().size());
+            break;
+        default: break;
+    }
+}
+
+
+void NoSweat::append_json_string(std::string& output, StringRef str) {
+    static const char hex_digits[] = "0123456789abcdef";
+    output += '"';
+    for (char c: str) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            output += '\\';
+            output += c;
+        }
+        else if (byte < 0x20) {
+            output += "\\u00";
+            output += hex_digits[byte >> 4];
+            output += hex_digits[byte & 0xf];
+        }
+        else {
+            output += c;
+        }
+    }
+    output += '"';
+}
+
+
+NoSweat::LiteralTable::LiteralTable(bool case_sensitive, std::initializer_list<std::pair<const char*, int>> literals)
+: case_sensitive_(case_sensitive), seed_(0) {
+    for (const std::pair<const char*, int>& literal: literals)
+        add(literal.first, literal.second);
+}
+
+
+NoSweat::LiteralTable NoSweat::default_type_keywords() {
+    return LiteralTable{true, {
+        {"int", int(ValueType::Integer)}, {"float", int(ValueType::Float)},
+        {"string", int(ValueType::String)}, {"bool", int(ValueType::Bool)},
+        {"int64", int(ValueType::Integer64)}, {"double", int(ValueType::Double)},
+        {"int[]", int(ValueType::IntegerArray)}, {"float[]", int(ValueType::FloatArray)},
+        {"int64[]", int(ValueType::Integer64Array)}, {"double[]", int(ValueType::DoubleArray)}}};
+}
+
+
+bool NoSweat::LiteralTable::add(StringRef literal, int value) {
+    if (literal.empty() || literal.size() > max_literal_size)
+        return false;
+    Slot slot = Slot();
+    for (std::size_t i = 0; i < literal.size(); i++)
+        slot.literal[i] = normalized(literal[i]);
+    slot.size = static_cast<std::uint8_t>(literal.size());
+    slot.value = value;
+    for (Slot& existing: literals_) {
+        if (existing.size == slot.size && std::memcmp(existing.literal, slot.literal, slot.size) == 0) {
+            existing.value = value;
+            slots_[slot_index(literal, seed_, slots_.size())].value = value;
+            return true;
+        }
+    }
+    literals_.push_back(slot);
+    rebuild();
+    return true;
+}
+
+
+int NoSweat::LiteralTable::find(StringRef word) const {
+    if (word.empty() || word.size() > max_literal_size || slots_.empty())
+        return -1;
+    const Slot& slot = slots_[slot_index(word, seed_, slots_.size())];
+    if (slot.size != word.size())
+        return -1;
+    for (std::size_t i = 0; i < word.size(); i++) {
+        if (normalized(word[i]) != slot.literal[i])
+            return -1;
+    }
+    return slot.value;
+}
+
+
+std::size_t NoSweat::LiteralTable::slot_index(StringRef word, std::uint32_t seed, std::size_t slot_count) const {
+    std::uint32_t hash = seed ^ 2166136261u;
+    for (std::size_t i = 0; i < word.size(); i++)
+        hash = (hash ^ static_cast<unsigned char>(normalized(word[i]))) * 16777619u;
+    return (hash ^ (hash >> 16)) & (slot_count - 1);
+}
+
+
+/// Tries a few seeds per table size before doubling it. Tables stay small,
+/// e.g. 32 slots for the boolean literals.
+void NoSweat::LiteralTable::rebuild() {
+    std::size_t slot_count = 8;
+    while (slot_count < 2 * literals_.size())
+        slot_count *= 2;
+    for (std::uint32_t seed = 1;; seed++) {
+        if (seed % 64 == 0)
+            slot_count *= 2;
+        std::vector<Slot> slots(slot_count, Slot());
+        bool collision = false;
+        for (const Slot& literal: literals_) {
+            Slot& slot = slots[slot_index(StringRef(literal.literal, literal.size), seed, slot_count)];
+            if (slot.size) {
+                collision = true;
+                break;
+            }
+            slot = literal;
+        }
+        if (!collision) {
+            slots_.swap(slots);
+            seed_ = seed;
+            return;
+        }
+    }
+}
+
+
+NoSweat::StringRef NoSweat::StringRef::substr(std::size_t pos, std::size_t count) const {
+    if (pos > size_)
+        pos = size_;
+    return StringRef(data_ + pos, std::min(count, size_ - pos));
+}
+
+
+std::size_t NoSweat::StringRef::find_first_of(StringRef chars, std::size_t pos) const {
+    for (; pos < size_; pos++) {
+        if (std::memchr(chars.data(), data_[pos], chars.size()))
+            return pos;
+    }
+    return std::string::npos;
+}
+
+
+bool NoSweat::StringRef::starts_with(StringRef prefix) const {
+    return size_ >= prefix.size() && std::memcmp(data_, prefix.data(), prefix.size()) == 0;
+}
+
+
+NoSweat::StringRef NoSweat::StringRef::trimmed() const {
+    // Same whitespaces as trim(): space, horizontal tab, new line, carriage return, vertical tab and line feed.
+    static const char whitespace_chars[] = " \t\n\r\v\f";
+    std::size_t begin = 0;
+    std::size_t end = size_;
+    while (begin < end && std::memchr(whitespace_chars, data_[begin], sizeof(whitespace_chars) - 1))
+        begin++;
+    while (end > begin && std::memchr(whitespace_chars, data_[end - 1], sizeof(whitespace_chars) - 1))
+        end--;
+    return StringRef(data_ + begin, end - begin);
+}
+
+
+bool NoSweat::operator==(StringRef lhs, StringRef rhs) {
+    // Empty references may be null, which memcmp() must not be passed.
+    return lhs.size() == rhs.size() && (lhs.empty() || std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+}
+
+
+bool NoSweat::operator!=(StringRef lhs, StringRef rhs) {
+    return !(lhs == rhs);
+}
+
+
+bool NoSweat::operator<(StringRef lhs, StringRef rhs) {
+    const std::size_t size = std::min(lhs.size(), rhs.size());
+    const int result = size ? std::memcmp(lhs.data(), rhs.data(), size) : 0;
+    return result < 0 || (result == 0 && lhs.size() < rhs.size());
+}
+
+
+std::ostream& NoSweat::operator<<(std::ostream& stream, StringRef str) {
+    return stream.write(str.data(), str.size());
+}
+
+
+/// Multiplicative hash of 64 bit words with a final avalanche step.
+std::uint64_t NoSweat::hash_bytes(StringRef bytes) {
+    const std::uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+    std::uint64_t hash = bytes.size() * multiplier;
+    std::size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    std::uint64_t word = 0;
+    std::memcpy(&word, bytes.data() + i, bytes.size() - i);
+    hash = (hash ^ word) * multiplier;
+    hash ^= hash >> 32;
+    hash *= multiplier;
+    return hash ^ (hash >> 29);
+}
+
+
+/// 64 bit FNV-1a hash.
+std::uint64_t NoSweat::hash_key(StringRef key) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (char c: key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+/// FNV-1a is computed byte by byte, so hashing can simply continue with the
+/// separator and the key.
+std::uint64_t NoSweat::hash_key(StringRef section, StringRef key) {
+    if (section.empty())
+        return hash_key(key);
+    std::uint64_t hash = hash_key(section);
+    hash ^= static_cast<unsigned char>('.');
+    hash *= 1099511628211ULL;
+    for (char c: key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+NoSweat::ValueStore::ValueStore()
+: slots_(16), used_slots_(0) {}
+
+
+NoSweat::ValueStore::ValueStore(const ValueStore& other)
+: slots_(other.slots_.size()), used_slots_(0) {
+    std::size_t strings_size = 0;
+    for (const ConfigEntry& entry: other.entries_) {
+        strings_size += entry.qualified_key().size();
+        if (entry.type == ValueType::String && entry.default_value.string_size > ConfigValue::inline_capacity)
+            strings_size += entry.default_value.string_size;
+        else if (array_element_size(entry.type))
+            strings_size += entry.default_value.string_size * array_element_size(entry.type) + alignof(double);
+    }
+    strings_.reserve(strings_size);
+    for (const ConfigEntry& entry: other.entries_) {
+        insert(entry.section(), entry.key, hash_key(entry.section(), entry.key), entry.type, entry.default_value,
+               entry.default_value.string());
+    }
+}
+
+
+NoSweat::ValueStore& NoSweat::ValueStore::operator=(ValueStore other) {
+    entries_.swap(other.entries_);
+    slots_.swap(other.slots_);
+    std::swap(used_slots_, other.used_slots_);
+    strings_ = std::move(other.strings_);
+    sections_.swap(other.sections_);
+    sorted_ids_.swap(other.sorted_ids_);
+    return *this;
+}
+
+
+std::size_t NoSweat::ValueStore::find_slot(StringRef section, StringRef key, std::uint64_t hash) const {
+    const std::uint32_t short_hash = static_cast<std::uint32_t>(hash >> 32);
+    const std::size_t mask = slots_.size() - 1;
+    const std::size_t size = section.empty() ? key.size() : section.size() + 1 + key.size();
+    // Linear probing.
+    for (std::size_t index = hash & mask; ; index = (index + 1) & mask) {
+        const Slot& slot = slots_[index];
+        if (!slot.entry)
+            return index;
+        if (slot.hash != short_hash)
+            continue;
+        const StringRef slot_string = slot_key(slot);
+        if (slot_string.size() != size)
+            continue;
+        if (section.empty() ? slot_string == key :
+            std::memcmp(slot_string.data(), section.data(), section.size()) == 0 &&
+            slot_string[section.size()] == '.' &&
+            std::memcmp(slot_string.data() + section.size() + 1, key.data(), key.size()) == 0)
+            return index;
+    }
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::ValueStore::find(StringRef key) const {
+    return find(StringRef(), key, hash_key(key));
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::ValueStore::find(StringRef section, StringRef key, std::uint64_t hash) const {
+    const Slot& slot = slots_[find_slot(section, key, hash)];
+    return slot.entry ? &entries_[(slot.entry & ~alias_bit) - 1] : nullptr;
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::ValueStore::insert(StringRef key, ValueType type,
+                                                        const ConfigValue& default_value, StringRef default_string) {
+    return insert(StringRef(), key, hash_key(key), type, default_value, default_string);
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::ValueStore::insert(StringRef section, StringRef key, std::uint64_t hash,
+                                                        ValueType type, const ConfigValue& default_value,
+                                                        StringRef default_string) {
+    ConfigEntry* entry = add(section, key, hash, type, default_value);
+    if (!entry)
+        return nullptr;
+    entry->key = StringRef(strings_.store_key(section, key), key.size());
+    if (type == ValueType::String)
+        strings_.assign(entry->default_value, default_string);
+    else if (array_element_size(type))
+        strings_.assign_array(entry->default_value, type);
+    add_alias(*entry);
+    return entry;
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::ValueStore::insert_external(StringRef qualified_key, std::uint32_t section_size,
+                                                                 ValueType type, const ConfigValue& default_value) {
+    return insert_external(qualified_key, section_size, hash_key(qualified_key), type, default_value);
+}
+
+
+const NoSweat::ConfigEntry* NoSweat::ValueStore::insert_external(StringRef qualified_key, std::uint32_t section_size,
+                                                                 std::uint64_t hash, ValueType type,
+                                                                 const ConfigValue& default_value) {
+    if (section_size && (section_size >= qualified_key.size() || qualified_key[section_size] != '.'))
+        return nullptr;
+    const StringRef section = qualified_key.substr(0, section_size);
+    const StringRef key = section_size ? qualified_key.substr(section_size + 1) : qualified_key;
+    ConfigEntry* entry = add(section, key, hash, type, default_value);
+    if (entry)
+        add_alias(*entry);
+    return entry;
+}
+
+
+/// Keys always replace aliases of the same name, so a key is found by its
+/// own name even if it has been added after a key of a section with that
+/// name.
+NoSweat::ConfigEntry* NoSweat::ValueStore::add(StringRef section, StringRef key, std::uint64_t hash, ValueType type,
+                                               const ConfigValue& default_value) {
+    std::size_t index = find_slot(section, key, hash);
+    const bool replaces_alias = (slots_[index].entry & alias_bit) != 0;
+    if (slots_[index].entry && !replaces_alias)
+        return nullptr;
+    // Keep the load factor below 1/2.
+    if (!replaces_alias && 2 * (used_slots_ + 1) > slots_.size()) {
+        grow();
+        index = find_slot(section, key, hash);
+    }
+    entries_.push_back(ConfigEntry());
+    ConfigEntry& entry = entries_.back();
+    entry.key = key;
+    entry.type = type;
+    entry.id = static_cast<std::uint32_t>(entries_.size() - 1);
+    entry.section_size = static_cast<std::uint32_t>(section.size());
+    entry.default_value = default_value;
+    if (!replaces_alias)
+        used_slots_++;
+    slots_[index].hash = static_cast<std::uint32_t>(hash >> 32);
+    slots_[index].entry = static_cast<std::uint32_t>(entries_.size());
+    // Entries of a section are usually added one after the other.
+    if (!section.empty() && (entries_.size() < 2 || entries_[entries_.size() - 2].section() != section))
+        sections_.insert(section.str());
+    return &entry;
+}
+
+
+void NoSweat::ValueStore::add_alias(const ConfigEntry& entry) {
+    if (!entry.section_size)
+        return;
+    const std::uint64_t hash = hash_key(entry.key);
+    std::size_t index = find_slot(StringRef(), entry.key, hash);
+    if (slots_[index].entry)
+        return;
+    if (2 * (used_slots_ + 1) > slots_.size()) {
+        grow();
+        index = find_slot(StringRef(), entry.key, hash);
+    }
+    used_slots_++;
+    slots_[index].hash = static_cast<std::uint32_t>(hash >> 32);
+    slots_[index].entry = (entry.id + 1) | alias_bit;
+}
+
+
+bool NoSweat::ValueStore::has_section(StringRef section) const {
+    const std::string name = section.str();
+    if (sections_.count(name))
+        return true;
+    // Subsections follow "section." in sort order.
+    std::set<std::string>::const_iterator subsection = sections_.lower_bound(name + ".");
+    return subsection != sections_.end() && StringRef(*subsection).starts_with(name + ".");
+}
+
+
+std::vector<const NoSweat::ConfigEntry*> NoSweat::ValueStore::entries_with_prefix(StringRef prefix) const {
+    // Entries are only ever added, so only the new ones have to be sorted in.
+    if (sorted_ids_.size() < entries_.size()) {
+        const std::size_t sorted_size = sorted_ids_.size();
+        for (std::size_t id = sorted_size; id < entries_.size(); id++)
+            sorted_ids_.push_back(static_cast<std::uint32_t>(id));
+        auto by_key = [this](std::uint32_t lhs, std::uint32_t rhs) {
+            return entries_[lhs].qualified_key() < entries_[rhs].qualified_key();
+        };
+        std::sort(sorted_ids_.begin() + sorted_size, sorted_ids_.end(), by_key);
+        std::inplace_merge(sorted_ids_.begin(), sorted_ids_.begin() + sorted_size, sorted_ids_.end(), by_key);
+    }
+    std::vector<const ConfigEntry*> entries;
+    std::vector<std::uint32_t>::const_iterator id = std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), prefix,
+        [this](std::uint32_t lhs, StringRef rhs) { return entries_[lhs].qualified_key() < rhs; });
+    for (; id != sorted_ids_.end() && entries_[*id].qualified_key().starts_with(prefix); ++id)
+        entries.push_back(&entries_[*id]);
+    return entries;
+}
+
+
+void NoSweat::ValueStore::reserve(std::size_t size) {
+    std::size_t slot_count = slots_.size();
+    while (2 * (size + 1) > slot_count)
+        slot_count *= 2;
+    if (slot_count > slots_.size())
+        rehash(slot_count);
+}
+
+
+void NoSweat::ValueStore::grow() {
+    rehash(slots_.size() * 2);
+}
+
+
+void NoSweat::ValueStore::rehash(std::size_t slot_count) {
+    std::vector<Slot> old_slots(slot_count);
+    old_slots.swap(slots_);
+    const std::size_t mask = slots_.size() - 1;
+    for (const Slot& slot: old_slots) {
+        if (!slot.entry)
+            continue;
+        std::size_t index = hash_key(slot_key(slot)) & mask;
+        while (slots_[index].entry)
+            index = (index + 1) & mask;
+        slots_[index] = slot;
+    }
+}
+
+
+void NoSweat::StringStorage::assign(ConfigValue& value, StringRef str) {
+    if (str.size() <= ConfigValue::inline_capacity)
+        std::memcpy(value.inline_string, str.data(), str.size());
+    else
+        value.external_string = store(str);
+    value.string_size = str.size();
+}
+
+
+/// Blocks are allocated with new[] and thus suitably aligned, so only
+/// the free part of the current block has to be aligned.
+char* NoSweat::StringStorage::allocate_array(std::size_t size) {
+    const std::size_t alignment = alignof(double);
+    std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(next_) % alignment) % alignment;
+    if (padding + size > available_) {
+        if (size > block_size_ / 2)
+            return allocate_block(size);
+        reserve(padding + size);
+        padding = 0;
+    }
+    char* elements = next_ + padding;
+    next_ += padding + size;
+    available_ -= padding + size;
+    return elements;
+}
+
+
+void NoSweat::StringStorage::assign_array(ConfigValue& value, ValueType type) {
+    const std::size_t size = value.string_size * array_element_size(type);
+    char* elements = allocate_array(size);
+    std::memcpy(elements, value.external_array, size);
+    value.external_array = elements;
+}
+
+
+void NoSweat::StringStorage::adopt(StringStorage&& other) {
+    for (std::unique_ptr<char[]>& block: other.blocks_)
+        blocks_.push_back(std::move(block));
+    other.blocks_.clear();
+    other.next_ = nullptr;
+    other.available_ = 0;
+}
+
+
+NoSweat::StringStorage::StringStorage(StringStorage&& other)
+: blocks_(std::move(other.blocks_)), next_(other.next_), available_(other.available_),
+  block_size_(other.block_size_) {
+    other.next_ = nullptr;
+    other.available_ = 0;
+    other.block_size_ = min_block_size;
+}
+
+
+NoSweat::StringStorage& NoSweat::StringStorage::operator=(StringStorage&& other) {
+    blocks_ = std::move(other.blocks_);
+    next_ = other.next_;
+    available_ = other.available_;
+    block_size_ = other.block_size_;
+    other.next_ = nullptr;
+    other.available_ = 0;
+    other.block_size_ = min_block_size;
+    return *this;
+}
+
+
+const char* NoSweat::StringStorage::store(StringRef str) {
+    if (str.size() > available_) {
+        // Strings longer than a block get one of their own and the rest of
+        // the current block is kept for the following strings.
+        if (str.size() > block_size_ / 2) {
+            char* copy = allocate_block(str.size());
+            std::memcpy(copy, str.data(), str.size());
+            return copy;
+        }
+        reserve(str.size());
+    }
+    char* copy = next_;
+    std::memcpy(copy, str.data(), str.size());
+    next_ += str.size();
+    available_ -= str.size();
+    return copy;
+}
+
+
+const char* NoSweat::StringStorage::store_key(StringRef section, StringRef key) {
+    if (section.empty())
+        return store(key);
+    const std::size_t size = section.size() + 1 + key.size();
+    char* copy;
+    if (size > available_ && size > block_size_ / 2) {
+        copy = allocate_block(size);
+    }
+    else {
+        reserve(size);
+        copy = next_;
+        next_ += size;
+        available_ -= size;
+    }
+    std::memcpy(copy, section.data(), section.size());
+    copy[section.size()] = '.';
+    std::memcpy(copy + section.size() + 1, key.data(), key.size());
+    return copy + section.size() + 1;
+}
+
+
+void NoSweat::StringStorage::reserve(std::size_t size) {
+    if (size <= available_)
+        return;
+    const std::size_t block_size = std::max(size, block_size_);
+    next_ = allocate_block(block_size);
+    available_ = block_size;
+    if (block_size_ < max_block_size)
+        block_size_ *= 2;
+}
+
+
+char* NoSweat::StringStorage::allocate_block(std::size_t size) {
+    blocks_.emplace_back(new char[size ? size : 1]);
+    return blocks_.back().get();
 }
 
 
-NoSweat::NoSweatConfigFileParser::NoSweatConfigFileParser() {};
-NoSweat::NoSweatConfigFileParser::~NoSweatConfigFileParser() {};
+namespace NoSweat {
+    // Index of the lowest set bit. The mask must not be zero.
+    inline unsigned lowest_set_bit(std::uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(mask);
+#else
+        unsigned index = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            index++;
+        }
+        return index;
+#endif
+    }
 
+    // Compute the newline and assignment operator (see
+    // assignment_operators) masks of a 64 byte block.
+    inline void block_masks_scalar(const char* block, std::uint64_t& newlines, std::uint64_t& assignments) {
+        newlines = 0;
+        assignments = 0;
+        for (unsigned i = 0; i < 64; i++) {
+            newlines |= static_cast<std::uint64_t>(block[i] == '\n') << i;
+            assignments |= static_cast<std::uint64_t>(block[i] == '=' || block[i] == ':') << i;
+        }
+    }
 
-/// Print the current state of the configuration parser. Intended for debugging.
-void NoSweat::NoSweatConfigFileParser::print_configuration() {
-    std::cout << "NoSweatConfigFileParser object: default_config_file='" << default_config_file_ <<
-        "', config_file='" << config_file_ << "'" << std::endl;
-    if (integer_config_values_.size()) {
-        std::cout << "\tInteger values:" << std::endl;
-        for (auto i: integer_config_values_) {
-            std::cout << "\t\t" << i.first << ": " << i.second.second << " (default value: " <<
-                i.second.first << ")" << std::endl;
-        }
-    }
-    if (float_config_values_.size()) {
-        std::cout << "\tFloat values:" << std::endl;
-        for (auto i: float_config_values_) {
-            std::cout << "\t\t" << i.first << ": " << i.second.second << " (default value: " <<
-                i.second.first << ")" << std::endl;
-        }
-    }
-    if (string_config_values_.size()) {
-        std::cout << "\tString values:" << std::endl;
-        for (auto i: string_config_values_) {
-            std::cout << "\t\t" << i.first << ": " << i.second.second << " (default value: " <<
-                i.second.first << ")" << std::endl;
-        }
-    if (bool_config_values_.size()) {
-        std::cout << "\tBoolean values:" << std::endl;
-        std::string pretty_bool_1;
-        std::string pretty_bool_2;
-        for (auto i: bool_config_values_) {
-            if (i.second.first)
-                pretty_bool_1 = "true";
-            else
-                pretty_bool_1 = "false";
-            if (i.second.second)
-                pretty_bool_2 = "true";
-            else
-                pretty_bool_2 = "false";
-            std::cout << "\t\t" << i.first << ": " << pretty_bool_2 << " (default value: " <<
-                pretty_bool_1 << ")" << std::endl;
+#ifdef NOSWEAT_HAVE_X86_SIMD
+    __attribute__((target("sse2")))
+    inline void block_masks_sse2(const char* block, std::uint64_t& newlines, std::uint64_t& assignments) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i equals = _mm_set1_epi8('=');
+        const __m128i colon = _mm_set1_epi8(':');
+        newlines = 0;
+        assignments = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+            const std::uint64_t chunk_newlines = static_cast<std::uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+            const std::uint64_t chunk_assignments = static_cast<std::uint32_t>(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, equals), _mm_cmpeq_epi8(chunk, colon))));
+            newlines |= chunk_newlines << (16 * i);
+            assignments |= chunk_assignments << (16 * i);
         }
     }
+
+    __attribute__((target("avx2")))
+    inline void block_masks_avx2(const char* block, std::uint64_t& newlines, std::uint64_t& assignments) {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i equals = _mm256_set1_epi8('=');
+        const __m256i colon = _mm256_set1_epi8(':');
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+        newlines = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline))) |
+            static_cast<std::uint64_t>(static_cast<std::uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)))) << 32;
+        assignments = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(low, equals), _mm256_cmpeq_epi8(low, colon)))) |
+            static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(high, equals), _mm256_cmpeq_epi8(high, colon))))) << 32;
     }
+#endif
+}
 
+
+NoSweat::SimdLevel NoSweat::detected_simd_level() {
+#ifdef NOSWEAT_HAVE_X86_SIMD
+    static const SimdLevel level = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return SimdLevel::SSE2;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
 }
 
 
-void NoSweat::NoSweatConfigFileParser::parse_default_config_file() {
-    std::ifstream file_stream{default_config_file_};
-    std::string current_line;
-    if (file_stream.is_open()) {
-        // Loop over all lines.
-        while (file_stream.good()) {
-            std::getline(file_stream, current_line);
-            trim(current_line);
-
-            // Check if the trimmed line starts with a value keyword.
-            bool starts_with_value_type{false};
-            for (auto type: accepted_value_types_) {
-                if (starts_with(current_line, type)) {
-                    starts_with_value_type = true;
-                    break;
-                }
-            }
-            if (!starts_with_value_type)
-                continue;
+NoSweat::LineScanner::LineScanner(const char* data, std::size_t size)
+: LineScanner(data, size, detected_simd_level()) {}
 
-            // Split at the first equals sign, or colon, if it has none, skip the line.
-            std::string::size_type index = current_line.find_first_of(accepted_assignment_operators_);
-            // If it either has none of these symbol or the first occurence is at the end, skip the line.
-            if (index == std::string::npos || index == (current_line.size() - 1))
-                continue;
-            // Otherwise split it in two parts.
-            std::string type_and_key{current_line.substr(0, index)};
-            std::string value{current_line.substr(index + 1)};
-            trim(type_and_key);
-            trim(value);
-
-            // These should never be able to have 0 length, but just check
-            // anyway because the library is not performance critical.
-            if (type_and_key.size() == 0 || value.size() == 0)
-                continue;
 
-            index = type_and_key.find(" ");
-            std::string type{type_and_key.substr(0, index)};
-            std::string key{type_and_key.substr(index + 1)};
-            trim(type);
-            trim(key);
-
-            if (type == "int")
-                add_default_integer_value(key, value);
-            else if (type == "float")
-                add_default_float_value(key, value);
-            else if (type == "string")
-                add_default_string_value(key, value);
-            else if (type == "bool")
-                add_default_bool_value(key, value);
-            else
-                continue;
-        }
-        file_stream.close();
-    }
-    else {
-        std::cout << "WARNING: Could not find the default configuration file " <<
-            default_config_file_ << "." << std::endl;
-    }
+/// Requesting an instruction set the CPU does not support results in
+/// undefined behaviour.
+NoSweat::LineScanner::LineScanner(const char* data, std::size_t size, SimdLevel simd_level)
+: data_(data), size_(size), position_(0), block_start_(0), newline_mask_(0), assignment_mask_(0),
+  block_mask_function_(&block_masks_scalar) {
+#ifdef NOSWEAT_HAVE_X86_SIMD
+    if (simd_level == SimdLevel::AVX2)
+        block_mask_function_ = &block_masks_avx2;
+    else if (simd_level == SimdLevel::SSE2)
+        block_mask_function_ = &block_masks_sse2;
+#else
+    (void)simd_level;
+#endif
+    if (size_)
+        scan_block(0);
 }
 
 
-void NoSweat::NoSweatConfigFileParser::read_config_file(std::string config_file) {
-    config_file_ = config_file;
-    std::ifstream file_stream{config_file_};
-    std::string current_line;
-    if (file_stream.is_open()) {
-        // Loop over all lines.
-        while (file_stream.good()) {
-            std::getline(file_stream, current_line);
-            trim(current_line);
-
-            std::string::size_type index{current_line.find_first_of("=:")};
-            if (index == std::string::npos || index == 0 || index == (current_line.size() - 1))
-                continue;
+void NoSweat::LineScanner::scan_block(std::size_t block_start) {
+    block_start_ = block_start;
+    if (size_ - block_start >= 64) {
+        block_mask_function_(data_ + block_start, newline_mask_, assignment_mask_);
+        return;
+    }
+    // Pad the last partial block. Null bytes never match.
+    char block[64] = {0};
+    std::memcpy(block, data_ + block_start, size_ - block_start);
+    block_mask_function_(block, newline_mask_, assignment_mask_);
+}
 
-            std::string key{current_line.substr(0, index)};
-            std::string value{current_line.substr(index + 1)};
-            trim(key);
-            trim(value);
-
-            // If the type is given in the user configuration file it will be
-            // enforced, e.g. it will not be accepted as a value for a key with
-            // the same name but a different type.
-            std::string enforce_type{""};
-            bool starts_with_value_type{false};
-            for (auto type: accepted_value_types_) {
-                if (starts_with(current_line, type)) {
-                    starts_with_value_type = true;
-                    break;
-                }
-            }
-            if (starts_with_value_type) {
-                index = key.find_first_of(" \t");
-                enforce_type=key.substr(0, index);
-                key.erase(0, index);
-                trim(key);
-            }
 
-            if (!enforce_type.empty()) {
-                if (enforce_type == "int")
-                    set_integer_value(key, value);
-                else if (enforce_type == "float")
-                    set_float_value(key, value);
-                else if (enforce_type == "string")
-                    set_string_value(key, value);
-                else if (enforce_type == "bool")
-                    set_bool_value(key, value);
-                continue;
-            }
-            set_value(key, value);
+bool NoSweat::LineScanner::next_statement(StringRef& statement, std::size_t& assignment_index) {
+    if (!next(statement, assignment_index))
+        return false;
+    if (assignment_index == std::string::npos)
+        return true;
+    StringRef line = statement;
+    while (ends_with_comma(line)) {
+        // Put the following line back unless it continues the statement.
+        const std::size_t position = position_;
+        const std::size_t block_start = block_start_;
+        const std::uint64_t newline_mask = newline_mask_;
+        const std::uint64_t assignment_mask = assignment_mask_;
+        std::size_t line_assignment_index;
+        if (!next(line, line_assignment_index))
+            break;
+        const StringRef trimmed_line = line.trimmed();
+        if (line_assignment_index != std::string::npos || trimmed_line.empty() || is_comment(trimmed_line) ||
+            trimmed_line[0] == '[') {
+            position_ = position;
+            block_start_ = block_start;
+            newline_mask_ = newline_mask;
+            assignment_mask_ = assignment_mask;
+            break;
         }
-        file_stream.close();
+        statement = StringRef(statement.data(), line.end() - statement.data());
     }
-    else {
-        std::cout << "WARNING: Could not find the configuration file " <<
-            config_file_ << "." << std::endl;
+    return true;
+}
+
+
+bool NoSweat::LineScanner::next(StringRef& line, std::size_t& assignment_index) {
+    if (position_ >= size_)
+        return false;
+    const std::size_t line_start = position_;
+    assignment_index = std::string::npos;
+    while (true) {
+        if (position_ - block_start_ >= 64)
+            scan_block(position_ - (position_ - block_start_) % 64);
+        // Ignore everything in the block before the current position.
+        const std::uint64_t valid = ~std::uint64_t(0) << (position_ - block_start_);
+        const std::uint64_t newlines = newline_mask_ & valid;
+        const std::uint64_t assignments = assignment_mask_ & valid;
+        if (assignment_index == std::string::npos && assignments) {
+            const std::size_t assignment = block_start_ + lowest_set_bit(assignments);
+            // Only if it occurs before the end of the line.
+            if (!newlines || assignment < block_start_ + lowest_set_bit(newlines))
+                assignment_index = assignment - line_start;
+        }
+        if (newlines) {
+            const std::size_t line_end = block_start_ + lowest_set_bit(newlines);
+            line = StringRef(data_ + line_start, line_end - line_start);
+            position_ = line_end + 1;
+            return true;
+        }
+        if (block_start_ + 64 >= size_) {
+            line = StringRef(data_ + line_start, size_ - line_start);
+            position_ = size_;
+            return true;
+        }
+        position_ = block_start_ + 64;
     }
 }
 
 
-void NoSweat::NoSweatConfigFileParser::add_default_integer_value(const std::string key, const std::string value) {
-    if (!is_key_available(key))
+NoSweat::MappedFile::MappedFile(const std::string& path)
+: data_(nullptr), size_(0), is_open_(false), is_mapped_(false) {
+#ifdef NOSWEAT_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
         return;
-    int int_value;
-    // Catch the possible exceptions.
-    try {
-        int_value = std::stoi(value);
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        void* mapping = ::mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            ::madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(mapping);
+            size_ = file_stat.st_size;
+            is_mapped_ = true;
+            is_open_ = true;
+        }
     }
-    catch (const std::invalid_argument& e) {
+    ::close(fd);
+    if (is_open_)
         return;
-    }
-    catch (const std::out_of_range& e) {
+#endif
+    // Empty files, pipes, ... and platforms without mmap.
+    read_into_buffer(path);
+}
+
+
+NoSweat::MappedFile::~MappedFile() {
+#ifdef NOSWEAT_HAVE_MMAP
+    if (is_mapped_)
+        ::munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+
+void NoSweat::MappedFile::read_into_buffer(const std::string& path) {
+    std::ifstream file_stream{path, std::ios::in | std::ios::binary};
+    if (!file_stream.is_open())
         return;
+    char chunk[65536];
+    while (file_stream.read(chunk, sizeof(chunk)) || file_stream.gcount())
+        buffer_.insert(buffer_.end(), chunk, chunk + file_stream.gcount());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    is_open_ = true;
+}
+
+
+#ifdef NOSWEAT_HAVE_MMAP
+NoSweat::ConfigStream::ConfigStream(int fd, std::size_t buffer_size)
+: type_keywords_(default_type_keywords()), fd_(fd), stream_(nullptr), buffer_(std::max<std::size_t>(buffer_size, 1)),
+  data_(buffer_.data()), begin_(0), end_(0), line_number_(0), at_end_(false), has_error_(false) {}
+#endif
+
+
+NoSweat::ConfigStream::ConfigStream(std::istream& stream, std::size_t buffer_size)
+: type_keywords_(default_type_keywords()), fd_(-1), stream_(&stream), buffer_(std::max<std::size_t>(buffer_size, 1)),
+  data_(buffer_.data()), begin_(0), end_(0), line_number_(0), at_end_(false), has_error_(false) {}
+
+
+NoSweat::ConfigStream::ConfigStream(const char* data, std::size_t size)
+: type_keywords_(default_type_keywords()), fd_(-1), stream_(nullptr), data_(data), begin_(0), end_(size),
+  line_number_(0), at_end_(true), has_error_(false) {}
+
+
+void NoSweat::ConfigStream::use_type_keywords(const NoSweatConfigFileParser& parser) {
+    std::lock_guard<std::mutex> lock{parser.snapshots_->write_mutex()};
+    type_keywords_ = parser.value_type_keywords_;
+}
+
+
+/// The lines of a statement stay unread until all of them are buffered, so
+/// a continued array is contiguous even if the buffer is filled meanwhile.
+/// Continuation lines are joined as by LineScanner::next_statement().
+bool NoSweat::ConfigStream::next(ConfigEvent& event) {
+    for (;;) {
+        std::size_t line_size;
+        std::size_t next_offset;
+        if (!find_line(0, line_size, next_offset))
+            return false;
+        line_number_++;
+        const std::size_t line_number = line_number_;
+        std::size_t assignment_index = StringRef(data_ + begin_, line_size).find_first_of(assignment_operators);
+        std::size_t statement_size = line_size;
+        std::size_t last_line_offset = 0;
+        while (assignment_index != std::string::npos &&
+               ends_with_comma(StringRef(data_ + begin_ + last_line_offset, statement_size - last_line_offset))) {
+            std::size_t continued_size;
+            std::size_t continued_next_offset;
+            if (!find_line(next_offset, continued_size, continued_next_offset))
+                break;
+            const StringRef continued{data_ + begin_ + next_offset, continued_size};
+            const StringRef trimmed_line = continued.trimmed();
+            if (continued.find_first_of(assignment_operators) != std::string::npos || trimmed_line.empty() ||
+                is_comment(trimmed_line) || trimmed_line[0] == '[')
+                break;
+            last_line_offset = next_offset;
+            statement_size = next_offset + continued_size;
+            next_offset = continued_next_offset;
+            line_number_++;
+        }
+        // Incomplete lines are dropped after a read error.
+        if (has_error_)
+            return false;
+        StringRef line{data_ + begin_, statement_size};
+        begin_ += next_offset;
+
+        line = trim_line(line, assignment_index);
+        if (line.empty() || is_comment(line))
+            continue;
+        StringRef section;
+        if (NoSweatConfigFileParser::section_header(line, section)) {
+            section_.assign(section.data(), section.size());
+            continue;
+        }
+        ConfigLine config_line;
+        if (!NoSweatConfigFileParser::tokenize_user_line(type_keywords_, line, assignment_index, config_line) ||
+            config_line.key.empty())
+            continue;
+        event.type = config_line.type;
+        event.section = section_;
+        event.key = config_line.key;
+        event.value = config_line.value;
+        event.line_number = line_number;
+        return true;
     }
-    integer_config_values_[key] = std::make_pair(int_value, int_value);
 }
 
 
-void NoSweat::NoSweatConfigFileParser::add_default_float_value(const std::string key, const std::string value) {
-    if (!is_key_available(key))
-        return;
-    float float_value;
-    // Catch the possible exceptions.
-    try {
-        float_value = std::stof(value);
+bool NoSweat::ConfigStream::find_line(std::size_t offset, std::size_t& size, std::size_t& next_offset) {
+    for (;;) {
+        const std::size_t line_begin = begin_ + offset;
+        const char* newline = line_begin < end_ ?
+            static_cast<const char*>(std::memchr(data_ + line_begin, '\n', end_ - line_begin)) : nullptr;
+        if (newline) {
+            size = newline - (data_ + line_begin);
+            next_offset = offset + size + 1;
+            return true;
+        }
+        if (!at_end_) {
+            fill();
+            continue;
+        }
+        if (line_begin >= end_)
+            return false;
+        // The last line has no newline.
+        size = end_ - line_begin;
+        next_offset = offset + size;
+        return true;
     }
-    catch (const std::invalid_argument& e) {
-        return;
+}
+
+
+void NoSweat::ConfigStream::fill() {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+    // Only a line longer than the buffer fills all of it.
+    if (end_ == buffer_.size())
+        buffer_.resize(2 * buffer_.size());
+    data_ = buffer_.data();
+    char* block = buffer_.data() + end_;
+    const std::size_t block_size = buffer_.size() - end_;
+    std::size_t count = 0;
+#ifdef NOSWEAT_HAVE_MMAP
+    if (fd_ >= 0) {
+        ssize_t result;
+        do {
+            result = ::read(fd_, block, block_size);
+        } while (result < 0 && errno == EINTR);
+        has_error_ = result < 0;
+        count = result > 0 ? result : 0;
     }
-    catch (const std::out_of_range& e) {
-        return;
+#endif
+    if (stream_) {
+        stream_->read(block, block_size);
+        has_error_ = stream_->bad();
+        count = stream_->gcount();
     }
-    float_config_values_[key] = std::make_pair(float_value, float_value);
+    // Incomplete lines are dropped after a read error.
+    if (has_error_)
+        begin_ = end_;
+    else
+        end_ += count;
+    at_end_ = count == 0 || has_error_;
 }
 
 
-void NoSweat::NoSweatConfigFileParser::add_default_string_value(const std::string key, std::string value) {
-    if (!is_key_available(key))
-        return;
-    string_config_values_[key] = std::make_pair(value, value);
+NoSweat::ValueSnapshot::ValueSnapshot(const ValueStore& store) {
+    values_.reserve(store.size());
+    for (const ConfigEntry& entry: store.entries())
+        values_.push_back(entry.default_value);
 }
 
 
-void NoSweat::NoSweatConfigFileParser::add_default_bool_value(const std::string key, std::string value) {
-    if (!is_key_available(key))
-        return;
-    // Transform to lower case.
-    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
-    bool bool_value;
-    // Map to corresponding boolean value.
-    if (std::find(accepted_boolean_false_values_.begin(), accepted_boolean_false_values_.end(), value) !=
-        accepted_boolean_false_values_.end())
-        bool_value = false;
-    else if (std::find(accepted_boolean_true_values_.begin(), accepted_boolean_true_values_.end(), value) != 
-        accepted_boolean_true_values_.end())
-        bool_value = true;
+NoSweat::ValueSnapshot::ValueSnapshot(const ValueSnapshot& other, const ValueStore& store) {
+    values_.reserve(store.size());
+    // The strings owned by the other snapshot are copied into a single block.
+    std::size_t strings_size = 0;
+    for (std::size_t id = 0; id < other.size(); id++) {
+        const ConfigEntry& entry = store.entry(id);
+        const ConfigValue& value = other[id];
+        if (entry.type == ValueType::String && value.string_size > ConfigValue::inline_capacity &&
+            value.string().data() != entry.default_value.string().data())
+            strings_size += value.string_size;
+        else if (array_element_size(entry.type) && value.external_array != entry.default_value.external_array)
+            strings_size += value.string_size * array_element_size(entry.type) + alignof(double);
+    }
+    strings_.reserve(strings_size);
+    for (const ConfigEntry& entry: store.entries()) {
+        if (entry.id >= other.size()) {
+            values_.push_back(entry.default_value);
+        }
+        else if (entry.type == ValueType::String) {
+            // Copy strings and arrays that are not owned by the store.
+            values_.push_back(ConfigValue());
+            set_string(entry, other[entry.id].string());
+        }
+        else if (array_element_size(entry.type)) {
+            values_.push_back(ConfigValue());
+            set_array(entry, other[entry.id]);
+        }
+        else {
+            values_.push_back(other[entry.id]);
+        }
+    }
+}
+
+
+void NoSweat::ValueSnapshot::set_string(const ConfigEntry& entry, StringRef str) {
+    if (str == entry.default_value.string())
+        values_[entry.id] = entry.default_value;
     else
-        return;
-    bool_config_values_[key] = std::make_pair(bool_value, bool_value);
+        strings_.assign(values_[entry.id], str);
 }
 
 
-/// Returns true if the key has not been taken yet. Checks key/value maps.
-/// It would be faster to keep a list of used keys around but I prefer simpler
-/// data structures as long as performance is not critical.
-bool NoSweat::NoSweatConfigFileParser::is_key_available(std::string key) {
-    if(integer_config_values_.find(key) != integer_config_values_.end())
-        return false;
-    else if(float_config_values_.find(key) != float_config_values_.end())
-        return false;
-    else if(string_config_values_.find(key) != string_config_values_.end())
-        return false;
-    else if(bool_config_values_.find(key) != bool_config_values_.end())
-        return false;
-    return true;
+void NoSweat::ValueSnapshot::set_array(const ConfigEntry& entry, const ConfigValue& value) {
+    if (values_equal(entry.type, value, entry.default_value)) {
+        values_[entry.id] = entry.default_value;
+    }
+    else {
+        values_[entry.id] = value;
+        strings_.assign_array(values_[entry.id], entry.type);
+    }
 }
 
 
-void NoSweat::NoSweatConfigFileParser::set_integer_value(const std::string key, const std::string value){
-    if (integer_config_values_.find(key) == integer_config_values_.end())
-        return;
-    int int_value;
-    // Catch the possible exceptions.
-    try {
-        int_value = std::stoi(value);
+std::size_t NoSweat::ChangeNotifier::subscribe(StringRef key, bool is_prefix, ValueType type, Callback callback) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    subscriptions_.push_back(Subscription{next_id_, key, is_prefix, type, callback});
+    return next_id_++;
+}
+
+
+void NoSweat::ChangeNotifier::unsubscribe(std::size_t id) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    subscriptions_.erase(std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+        [id](const Subscription& subscription) { return subscription.id == id; }), subscriptions_.end());
+}
+
+
+/// The matching functions are collected first and then called in the order
+/// of the changes, so they are free to change the subscriptions.
+void NoSweat::ChangeNotifier::notify(const ChangeSet& changes, const ValueSnapshot& old_values,
+                                     const ValueSnapshot& new_values) const {
+    std::vector<std::pair<const ConfigEntry*, Callback>> calls;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for (const ConfigEntry* entry: changes) {
+            for (const Subscription& subscription: subscriptions_) {
+                // Keys of sections match by their plain and their qualified name.
+                const StringRef qualified_key = entry->qualified_key();
+                if (subscription.type == entry->type && (subscription.is_prefix ?
+                        entry->key.starts_with(subscription.key) || qualified_key.starts_with(subscription.key) :
+                        entry->key == subscription.key || qualified_key == subscription.key))
+                    calls.push_back(std::make_pair(entry, subscription.callback));
+            }
+        }
     }
-    catch (const std::invalid_argument& e) {
-        return;
+    for (const std::pair<const ConfigEntry*, Callback>& call: calls)
+        call.second(*call.first, old_values[call.first->id], new_values[call.first->id]);
+}
+
+
+namespace NoSweat {
+    // Readers on the same thread always use the same counter stripe.
+    inline unsigned reader_stripe() {
+        static std::atomic<unsigned> next_stripe{0};
+        static thread_local unsigned stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) %
+            SnapshotPointer::stripes;
+        return stripe;
     }
-    catch (const std::out_of_range& e) {
+}
+
+
+#ifdef NOSWEAT_INSTRUMENTATION
+NoSweat::Instrumentation::Instrumentation() {
+    for (std::atomic<std::atomic<std::uint64_t>*>& block: read_counts_)
+        block.store(nullptr);
+    for (std::atomic<std::uint64_t>& nanoseconds: phase_nanoseconds_)
+        nanoseconds.store(0);
+}
+
+
+NoSweat::Instrumentation::~Instrumentation() {
+    for (std::atomic<std::atomic<std::uint64_t>*>& block: read_counts_)
+        delete[] block.load();
+}
+
+
+/// The first reader of a block allocates it. If several do at the same
+/// time, the first to store its block wins and the others delete theirs.
+void NoSweat::Instrumentation::record_read(std::uint32_t id) const {
+    if (id >= block_size * max_blocks)
         return;
+    std::atomic<std::atomic<std::uint64_t>*>& block_pointer = read_counts_[id / block_size];
+    std::atomic<std::uint64_t>* block = block_pointer.load(std::memory_order_acquire);
+    if (!block) {
+        std::atomic<std::uint64_t>* new_block = new std::atomic<std::uint64_t>[block_size]();
+        if (block_pointer.compare_exchange_strong(block, new_block, std::memory_order_acq_rel))
+            block = new_block;
+        else
+            delete[] new_block;
     }
-    integer_config_values_[key].second = int_value;
+    block[id % block_size].fetch_add(1, std::memory_order_relaxed);
 }
 
 
-void NoSweat::NoSweatConfigFileParser::set_float_value(const std::string key, const std::string value) {
-    if (float_config_values_.find(key) == float_config_values_.end())
-        return;
-    float float_value;
-    // Catch the possible exceptions.
-    try {
-        float_value = std::stof(value);
+void NoSweat::Instrumentation::record_miss(StringRef key, ValueType type) const {
+    std::lock_guard<std::mutex> lock{misses_mutex_};
+    misses_[std::make_pair(key.str(), type)]++;
+}
+
+
+std::uint64_t NoSweat::Instrumentation::reads(std::uint32_t id) const {
+    if (id >= block_size * max_blocks)
+        return 0;
+    const std::atomic<std::uint64_t>* block = read_counts_[id / block_size].load(std::memory_order_acquire);
+    return block ? block[id % block_size].load(std::memory_order_relaxed) : 0;
+}
+
+
+void NoSweat::Instrumentation::stats(InstrumentationStats& stats) const {
+    stats.enabled = true;
+    {
+        std::lock_guard<std::mutex> lock{misses_mutex_};
+        for (const auto& miss: misses_)
+            stats.misses.push_back(KeyCount{miss.first.first, miss.first.second, miss.second});
     }
-    catch (const std::invalid_argument& e) {
-        return;
+    std::sort(stats.misses.begin(), stats.misses.end(), [](const KeyCount& lhs, const KeyCount& rhs) {
+        return lhs.count > rhs.count || (lhs.count == rhs.count && lhs.key < rhs.key);
+    });
+    for (int phase = 0; phase < 4; phase++)
+        stats.phase_nanoseconds[phase] = phase_nanoseconds_[phase].load();
+}
+#endif
+
+
+NoSweat::SnapshotPointer::SnapshotPointer(const ValueSnapshot* snapshot)
+: epoch_(0), snapshot_(snapshot) {
+    for (auto& epoch_readers: readers_) {
+        for (ReaderCounter& counter: epoch_readers)
+            counter.count.store(0);
     }
-    catch (const std::out_of_range& e) {
-        return;
+}
+
+
+NoSweat::SnapshotPointer::~SnapshotPointer() {
+    delete snapshot_.load();
+}
+
+
+/// After the swap, readers of the old snapshot can be registered in either
+/// epoch. New readers register in the current epoch, so the other one is
+/// drained first (only stragglers that read the epoch before the last switch
+/// can be in there), then the epoch is switched and the previously current
+/// one drained. Afterwards nobody can hold the old snapshot.
+std::unique_ptr<const NoSweat::ValueSnapshot> NoSweat::SnapshotPointer::exchange(const ValueSnapshot* snapshot) {
+    std::unique_ptr<const ValueSnapshot> old_snapshot{snapshot_.exchange(snapshot)};
+    const unsigned epoch = epoch_.load();
+    wait_for_readers(epoch + 1);
+    epoch_.store(epoch + 1);
+    wait_for_readers(epoch);
+    return old_snapshot;
+}
+
+
+void NoSweat::SnapshotPointer::wait_for_readers(unsigned epoch) const {
+    for (ReaderCounter& counter: readers_[epoch & 1]) {
+        while (counter.count.load())
+            std::this_thread::yield();
     }
-    float_config_values_[key].second = float_value;
 }
 
 
-void NoSweat::NoSweatConfigFileParser::set_string_value(const std::string key, std::string value) {
-    if (string_config_values_.find(key) == string_config_values_.end())
-        return;
-    string_config_values_[key].second = value;
+NoSweat::SnapshotPointer::ReadGuard::ReadGuard(const SnapshotPointer& pointer)
+: reader_count_(&pointer.readers_[pointer.epoch_.load() & 1][reader_stripe()].count) {
+    reader_count_->fetch_add(1);
+    snapshot_ = pointer.snapshot_.load();
 }
 
 
-void NoSweat::NoSweatConfigFileParser::set_bool_value(const std::string key, std::string value) {
-    if (bool_config_values_.find(key) == bool_config_values_.end())
-        return;
-    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
-    // Map to corresponding boolean value.
-    bool bool_value;
-    if (std::find(accepted_boolean_false_values_.begin(), accepted_boolean_false_values_.end(), value) !=
-        accepted_boolean_false_values_.end())
-        bool_value = false;
-    else if (std::find(accepted_boolean_true_values_.begin(), accepted_boolean_true_values_.end(), value) != 
-        accepted_boolean_true_values_.end())
-        bool_value = true;
-    else
-        return;
-    bool_config_values_[key].second = bool_value;
+NoSweat::SnapshotPointer::ReadGuard::~ReadGuard() {
+    reader_count_->fetch_sub(1, std::memory_order_release);
 }
 
 
-void NoSweat::NoSweatConfigFileParser::set_value(const std::string key, std::string value) {
-    if (integer_config_values_.find(key) != integer_config_values_.end())
-        set_integer_value(key, value);
-    else if (float_config_values_.find(key) != float_config_values_.end())
-        set_float_value(key, value);
-    else if (string_config_values_.find(key) != string_config_values_.end())
-        set_string_value(key, value);
-    else if (bool_config_values_.find(key) != bool_config_values_.end())
-        set_bool_value(key, value);
+NoSweat::ConfigView::ConfigView(const NoSweatConfigFileParser& parser)
+: snapshots_(parser.snapshots_.get()), guard_(*snapshots_) {}
+
+
+int NoSweat::NoSweatConfigFileParser::get_int(StringRef key) const {
+    return get_value<int>(key);
 }
 
 
-/// Two-sided in-place whitespace trimming.
-inline void NoSweat::trim(std::string& str) {
-    // Define all needed whitespaces: space, horizontal tab, new line, carriage return, vertical tab and line feed.
-    std::string whitespace_chars{" \t\n\r\v\f"};
-    // Remove leading spaces.
-    str.erase(0, str.find_first_not_of(whitespace_chars));
-    // Remove trailing spaces.
-    str.erase(str.find_last_not_of(whitespace_chars) + 1);
+int NoSweat::NoSweatConfigFileParser::get_int(KeyId id) const {
+    return get_value<int>(id);
 }
 
 
-/// Return true, if str starts with substr, false otherwise.
-inline bool NoSweat::starts_with(const std::string str, const std::string substr) {
-    std::string::size_type length = substr.size();
-    if (length == 0) {
-        // Obviously always true.
-        return true;
+float NoSweat::NoSweatConfigFileParser::get_float(StringRef key) const {
+    return get_value<float>(key);
+}
+
+
+float NoSweat::NoSweatConfigFileParser::get_float(KeyId id) const {
+    return get_value<float>(id);
+}
+
+
+std::string NoSweat::NoSweatConfigFileParser::get_string(StringRef key) const {
+    return get_value<std::string>(key);
+}
+
+
+std::string NoSweat::NoSweatConfigFileParser::get_string(KeyId id) const {
+    return get_value<std::string>(id);
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::get_bool(StringRef key) const {
+    return get_value<bool>(key);
+}
+
+
+bool NoSweat::NoSweatConfigFileParser::get_bool(KeyId id) const {
+    return get_value<bool>(id);
+}
+
+
+std::int64_t NoSweat::NoSweatConfigFileParser::get_int64(StringRef key) const {
+    return get_value<std::int64_t>(key);
+}
+
+
+std::int64_t NoSweat::NoSweatConfigFileParser::get_int64(KeyId id) const {
+    return get_value<std::int64_t>(id);
+}
+
+
+double NoSweat::NoSweatConfigFileParser::get_double(StringRef key) const {
+    return get_value<double>(key);
+}
+
+
+double NoSweat::NoSweatConfigFileParser::get_double(KeyId id) const {
+    return get_value<double>(id);
+}
+
+
+std::vector<int> NoSweat::NoSweatConfigFileParser::get_int_array(StringRef key) const {
+    return get_value<std::vector<int>>(key);
+}
+
+
+std::vector<int> NoSweat::NoSweatConfigFileParser::get_int_array(KeyId id) const {
+    return get_value<std::vector<int>>(id);
+}
+
+
+std::vector<float> NoSweat::NoSweatConfigFileParser::get_float_array(StringRef key) const {
+    return get_value<std::vector<float>>(key);
+}
+
+
+std::vector<float> NoSweat::NoSweatConfigFileParser::get_float_array(KeyId id) const {
+    return get_value<std::vector<float>>(id);
+}
+
+
+std::vector<std::int64_t> NoSweat::NoSweatConfigFileParser::get_int64_array(StringRef key) const {
+    return get_value<std::vector<std::int64_t>>(key);
+}
+
+
+std::vector<std::int64_t> NoSweat::NoSweatConfigFileParser::get_int64_array(KeyId id) const {
+    return get_value<std::vector<std::int64_t>>(id);
+}
+
+
+std::vector<double> NoSweat::NoSweatConfigFileParser::get_double_array(StringRef key) const {
+    return get_value<std::vector<double>>(key);
+}
+
+
+std::vector<double> NoSweat::NoSweatConfigFileParser::get_double_array(KeyId id) const {
+    return get_value<std::vector<double>>(id);
+}
+
+
+template<typename T>
+typename NoSweat::ValueTraits<T>::value_type NoSweat::NoSweatConfigFileParser::get_value(StringRef key) const {
+    const ConfigEntry* entry = find_entry(key, ValueTraits<T>::type);
+    if (!entry)
+        return typename ValueTraits<T>::value_type();
+    snapshots_->instrumentation().record_read(entry->id);
+    SnapshotPointer::ReadGuard guard{*snapshots_};
+    return ValueTraits<T>::get((*guard)[entry->id]);
+}
+
+
+template<typename T>
+typename NoSweat::ValueTraits<T>::value_type NoSweat::NoSweatConfigFileParser::get_value(KeyId id) const {
+    if (!id.is_valid() || id.value() >= values_.size())
+        return typename ValueTraits<T>::value_type();
+    const ConfigEntry& entry = values_.entry(id.value());
+    if (entry.type != ValueTraits<T>::type) {
+        snapshots_->instrumentation().record_miss(entry.key, ValueTraits<T>::type);
+        return typename ValueTraits<T>::value_type();
     }
-    if (str.substr(0, length) == substr)
-        return true;
-    return false;
+    snapshots_->instrumentation().record_read(entry.id);
+    SnapshotPointer::ReadGuard guard{*snapshots_};
+    // Keys added after the current values have been published have none yet.
+    if (entry.id >= guard->size())
+        return typename ValueTraits<T>::value_type();
+    return ValueTraits<T>::get((*guard)[entry.id]);
 }
 
 
-int NoSweat::NoSweatConfigFileParser::get_int(std::string key) {
-    if (integer_config_values_.find(key) == integer_config_values_.end())
-        return 0;
-    return integer_config_values_[key].second;
+NoSweat::KeyId NoSweat::NoSweatConfigFileParser::key_id(StringRef key) const {
+    const ConfigEntry* entry = values_.find(key);
+    return entry ? KeyId(entry->id) : KeyId();
 }
 
 
-float NoSweat::NoSweatConfigFileParser::get_float(std::string key) {
-    if (float_config_values_.find(key) == float_config_values_.end())
-        return 0.0;
-    return float_config_values_[key].second;
+NoSweat::StringRef NoSweat::NoSweatConfigFileParser::key_name(KeyId id) const {
+    if (!id.is_valid() || id.value() >= values_.size())
+        return StringRef();
+    return values_.entry(id.value()).key;
 }
 
 
-std::string NoSweat::NoSweatConfigFileParser::get_string(std::string key) {
-    if (string_config_values_.find(key) == string_config_values_.end())
-        return "";
-    return string_config_values_[key].second;
+std::vector<const NoSweat::ConfigEntry*> NoSweat::NoSweatConfigFileParser::section_entries(StringRef section) const {
+    return keys_with_prefix(section.str() + ".");
 }
 
 
-bool NoSweat::NoSweatConfigFileParser::get_bool(std::string key) {
-    if (bool_config_values_.find(key) == bool_config_values_.end())
-        return false;
-    return bool_config_values_[key].second;
+/// Keys are only ever added, so the entries stay valid for the lifetime of
+/// the parser.
+std::vector<const NoSweat::ConfigEntry*> NoSweat::NoSweatConfigFileParser::keys_with_prefix(StringRef prefix) const {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    return values_.entries_with_prefix(prefix);
+}
+
+
+std::vector<std::string> NoSweat::NoSweatConfigFileParser::sections() const {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    return std::vector<std::string>(values_.sections().begin(), values_.sections().end());
+}
+
+
+/// Resolve the key once. The returned handle stays valid for the lifetime of
+/// the parser and always reflects the current value, e.g. after
+/// read_config_file() has been called. If the key does not exist with the
+/// requested type, the handle will return the default value of the type.
+template<typename T>
+NoSweat::Handle<T> NoSweat::NoSweatConfigFileParser::get_handle(StringRef key) const {
+    const ConfigEntry* entry = find_entry(key, ValueTraits<T>::type);
+    if (!entry)
+        return Handle<T>();
+    return Handle<T>(snapshots_.get(), entry->id);
+}
+
+
+/// Keys that already exist keep their type and default value.
+template<typename Schema>
+void NoSweat::NoSweatConfigFileParser::add_schema(const Schema& schema) {
+    std::lock_guard<std::mutex> lock{snapshots_->write_mutex()};
+    SchemaDefaults defaults{*this};
+    schema.visit(defaults);
+    publish_new_keys();
+}
+
+
+template<typename Schema>
+void NoSweat::NoSweatConfigFileParser::fill(Schema& schema) const {
+    SnapshotPointer::ReadGuard guard{*snapshots_};
+    SchemaFiller filler{*this, *guard};
+    schema.visit(filler);
 }
 
 #endif
@@ -0,0 +1,429 @@
+/*****************************************************************************
+Copyright (c) 2012 Lion Krischer (krischer@geophysik.uni-muenchen.de)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+/// @file NoSweatConfigFileWatcher.hpp
+///
+/// Optional automatic reloading of configuration files. Needs a POSIX system.
+
+#ifndef __NOSWEAT_CONFIGFILE_WATCHER__
+#define __NOSWEAT_CONFIGFILE_WATCHER__
+
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#define NOSWEAT_HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+#include "NoSweatConfigFileParser.hpp"
+
+namespace NoSweat {
+    /// Watches files and calls a function once they have changed. All
+    /// watched files share a single background thread, which sleeps in poll()
+    /// on an inotify descriptor or, where inotify is not available, wakes up
+    /// at a fixed interval to compare the files' status. The directories of
+    /// the files are watched, so files replaced by renaming another file over
+    /// them are detected as well. Files in directories inotify cannot watch,
+    /// e.g. ones that do not exist yet, are polled. Bursts of changes are
+    /// debounced: the function is called once no further change happened for
+    /// the debounce interval. The functions are called on the background
+    /// thread.
+    class ConfigFileWatcher {
+        public:
+            // Polling is used if use_inotify is false or inotify is not available.
+            inline explicit ConfigFileWatcher(bool use_inotify = true);
+            inline ~ConfigFileWatcher();
+
+            // The watcher shared by the whole process.
+            static inline ConfigFileWatcher& instance();
+
+            // Call on_change whenever the file changes. Return an id for unwatch().
+            inline std::size_t watch(const std::string& path, std::function<void()> on_change);
+            // Reload the parser whenever its configuration file changes. Only
+            // a pointer to the parser is kept, so it has to be unwatched
+            // before it is destroyed or moved, as the reload runs on the
+            // background thread at any time.
+            inline std::size_t watch(NoSweatConfigFileParser& parser);
+            // Stop watching. Once it returns, the function will not be called any more.
+            inline void unwatch(std::size_t id);
+
+            inline void set_debounce_interval(std::chrono::milliseconds interval);
+            inline void set_poll_interval(std::chrono::milliseconds interval);
+            bool uses_inotify() const { return inotify_fd_ >= 0; }
+
+        private:
+            typedef std::chrono::steady_clock Clock;
+
+            // Identifies a version of a file for polling.
+            struct FileStatus {
+                bool exists;
+                dev_t device;
+                ino_t inode;
+                off_t size;
+                time_t modification_time;
+                long modification_time_ns;
+
+                bool operator!=(const FileStatus& other) const {
+                    return exists != other.exists || device != other.device || inode != other.inode ||
+                        size != other.size || modification_time != other.modification_time ||
+                        modification_time_ns != other.modification_time_ns;
+                }
+            };
+
+            struct Watch {
+                std::string directory;
+                std::string name;
+                std::function<void()> on_change;
+                FileStatus status;
+                bool is_pending;
+                Clock::time_point due;
+            };
+
+            ConfigFileWatcher(const ConfigFileWatcher&);
+            ConfigFileWatcher& operator=(const ConfigFileWatcher&);
+
+            static inline FileStatus file_status(const std::string& path);
+            inline void run();
+            inline void wake_up();
+            // Handle all queued inotify events.
+            inline void read_inotify_events();
+            // Compare the status of all polled files.
+            inline void poll_files();
+            // True if the file is polled instead of watched by inotify.
+            inline bool is_polled(const Watch& watch) const;
+            // Call the functions of all watches whose debounce interval has passed.
+            inline void dispatch_due();
+            // How long poll() may sleep, in milliseconds, or -1.
+            inline int poll_timeout();
+            inline void add_directory_watch(const std::string& directory);
+            inline void remove_directory_watch(const std::string& directory);
+
+            // Protects all members below except for the descriptors.
+            std::mutex mutex_;
+            // Held while calling the functions, so unwatch() can wait for them.
+            std::recursive_mutex dispatch_mutex_;
+            std::map<std::size_t, Watch> watches_;
+            std::size_t next_id_;
+            // inotify watch descriptor and number of watches per directory.
+            std::map<std::string, std::pair<int, int>> directories_;
+            std::chrono::milliseconds debounce_interval_;
+            std::chrono::milliseconds poll_interval_;
+            bool stop_;
+            int inotify_fd_;
+            // Used to wake the background thread up.
+            int wake_up_pipe_[2];
+            std::thread thread_;
+    };
+}
+
+
+NoSweat::ConfigFileWatcher::ConfigFileWatcher(bool use_inotify)
+: next_id_(0), debounce_interval_(100), poll_interval_(1000), stop_(false), inotify_fd_(-1) {
+#ifdef NOSWEAT_HAVE_INOTIFY
+    if (use_inotify)
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+    (void)use_inotify;
+#endif
+    // Without the pipe, the thread wakes up at the poll interval to stop.
+    if (::pipe(wake_up_pipe_) != 0) {
+        wake_up_pipe_[0] = -1;
+        wake_up_pipe_[1] = -1;
+    }
+    for (int fd: wake_up_pipe_) {
+        if (fd >= 0) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    thread_ = std::thread(&ConfigFileWatcher::run, this);
+}
+
+
+NoSweat::ConfigFileWatcher::~ConfigFileWatcher() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_ = true;
+    }
+    wake_up();
+    thread_.join();
+    for (int fd: {inotify_fd_, wake_up_pipe_[0], wake_up_pipe_[1]}) {
+        if (fd >= 0)
+            ::close(fd);
+    }
+}
+
+
+NoSweat::ConfigFileWatcher& NoSweat::ConfigFileWatcher::instance() {
+    static ConfigFileWatcher watcher;
+    return watcher;
+}
+
+
+std::size_t NoSweat::ConfigFileWatcher::watch(const std::string& path, std::function<void()> on_change) {
+    Watch watch;
+    const std::string::size_type slash = path.rfind('/');
+    watch.directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    watch.name = slash == std::string::npos ? path : path.substr(slash + 1);
+    watch.on_change = on_change;
+    watch.status = file_status(path);
+    watch.is_pending = false;
+
+    std::size_t id;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        id = next_id_++;
+        add_directory_watch(watch.directory);
+        watches_[id] = watch;
+    }
+    wake_up();
+    return id;
+}
+
+
+std::size_t NoSweat::ConfigFileWatcher::watch(NoSweatConfigFileParser& parser) {
+    NoSweatConfigFileParser* parser_pointer = &parser;
+    return watch(parser.config_file(), [parser_pointer]() { parser_pointer->reload_config_file(); });
+}
+
+
+void NoSweat::ConfigFileWatcher::unwatch(std::size_t id) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = watches_.find(id);
+        if (it == watches_.end())
+            return;
+        remove_directory_watch(it->second.directory);
+        watches_.erase(it);
+    }
+    // Wait for a running call to finish.
+    std::lock_guard<std::recursive_mutex> dispatch_lock{dispatch_mutex_};
+}
+
+
+void NoSweat::ConfigFileWatcher::set_debounce_interval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    debounce_interval_ = interval;
+}
+
+
+void NoSweat::ConfigFileWatcher::set_poll_interval(std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        poll_interval_ = interval;
+    }
+    wake_up();
+}
+
+
+NoSweat::ConfigFileWatcher::FileStatus NoSweat::ConfigFileWatcher::file_status(const std::string& path) {
+    FileStatus status = FileStatus();
+    struct stat file_stat;
+    if (::stat(path.c_str(), &file_stat) != 0)
+        return status;
+    status.exists = true;
+    status.device = file_stat.st_dev;
+    status.inode = file_stat.st_ino;
+    status.size = file_stat.st_size;
+    status.modification_time = file_stat.st_mtime;
+#if defined(__APPLE__)
+    status.modification_time_ns = file_stat.st_mtimespec.tv_nsec;
+#else
+    status.modification_time_ns = file_stat.st_mtim.tv_nsec;
+#endif
+    return status;
+}
+
+
+void NoSweat::ConfigFileWatcher::run() {
+    while (true) {
+        int timeout;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (stop_)
+                return;
+            timeout = poll_timeout();
+        }
+        struct pollfd descriptors[2] = {{wake_up_pipe_[0], POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+        ::poll(descriptors, inotify_fd_ >= 0 ? 2 : 1, timeout);
+
+        // Drain the wake up pipe.
+        char buffer[64];
+        while (::read(wake_up_pipe_[0], buffer, sizeof(buffer)) > 0) {}
+
+        if (inotify_fd_ >= 0)
+            read_inotify_events();
+        poll_files();
+        dispatch_due();
+    }
+}
+
+
+void NoSweat::ConfigFileWatcher::wake_up() {
+    const char byte = 0;
+    if (::write(wake_up_pipe_[1], &byte, 1) < 0) {
+        // The pipe is full, so the thread will wake up anyway.
+    }
+}
+
+
+void NoSweat::ConfigFileWatcher::read_inotify_events() {
+#ifdef NOSWEAT_HAVE_INOTIFY
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        const ssize_t length = ::read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0)
+            return;
+        std::lock_guard<std::mutex> lock{mutex_};
+        for (const char* position = buffer; position < buffer + length; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(position);
+            position += sizeof(struct inotify_event) + event->len;
+            if (!event->len)
+                continue;
+            for (auto& id_and_watch: watches_) {
+                Watch& watch = id_and_watch.second;
+                auto directory = directories_.find(watch.directory);
+                if (directory != directories_.end() && directory->second.first == event->wd &&
+                    watch.name == event->name) {
+                    watch.is_pending = true;
+                    watch.due = Clock::now() + debounce_interval_;
+                }
+            }
+        }
+    }
+#endif
+}
+
+
+void NoSweat::ConfigFileWatcher::poll_files() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto& id_and_watch: watches_) {
+        Watch& watch = id_and_watch.second;
+        if (!is_polled(watch))
+            continue;
+        const FileStatus status = file_status(watch.directory + "/" + watch.name);
+        if (status != watch.status) {
+            watch.status = status;
+            watch.is_pending = true;
+            watch.due = Clock::now() + debounce_interval_;
+        }
+    }
+}
+
+
+bool NoSweat::ConfigFileWatcher::is_polled(const Watch& watch) const {
+    if (inotify_fd_ < 0)
+        return true;
+    auto directory = directories_.find(watch.directory);
+    return directory == directories_.end() || directory->second.first < 0;
+}
+
+
+void NoSweat::ConfigFileWatcher::dispatch_due() {
+    std::lock_guard<std::recursive_mutex> dispatch_lock{dispatch_mutex_};
+    std::vector<std::size_t> due_ids;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const Clock::time_point now = Clock::now();
+        for (auto& id_and_watch: watches_) {
+            Watch& watch = id_and_watch.second;
+            if (watch.is_pending && watch.due <= now) {
+                watch.is_pending = false;
+                due_ids.push_back(id_and_watch.first);
+            }
+        }
+    }
+    // The functions are called without holding mutex_, so they may (un)watch files.
+    for (std::size_t id: due_ids) {
+        std::function<void()> on_change;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = watches_.find(id);
+            if (it == watches_.end())
+                continue;
+            on_change = it->second.on_change;
+        }
+        on_change();
+    }
+}
+
+
+int NoSweat::ConfigFileWatcher::poll_timeout() {
+    Clock::duration timeout = Clock::duration::max();
+    if (wake_up_pipe_[0] < 0)
+        timeout = poll_interval_;
+    const Clock::time_point now = Clock::now();
+    for (auto& id_and_watch: watches_) {
+        const Watch& watch = id_and_watch.second;
+        if (is_polled(watch))
+            timeout = std::min<Clock::duration>(timeout, poll_interval_);
+        if (watch.is_pending)
+            timeout = std::min<Clock::duration>(timeout, watch.due > now ? watch.due - now : Clock::duration::zero());
+    }
+    if (timeout == Clock::duration::max())
+        return -1;
+    // Round up, so the debounce interval has passed when waking up.
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count()) + 1;
+}
+
+
+void NoSweat::ConfigFileWatcher::add_directory_watch(const std::string& directory) {
+    auto it = directories_.find(directory);
+    if (it != directories_.end()) {
+        it->second.second++;
+        return;
+    }
+    // Files in the directory are polled if this fails.
+    int watch_descriptor = -1;
+#ifdef NOSWEAT_HAVE_INOTIFY
+    if (inotify_fd_ >= 0)
+        watch_descriptor = inotify_add_watch(inotify_fd_, directory.c_str(),
+                                             IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE);
+#endif
+    directories_[directory] = std::make_pair(watch_descriptor, 1);
+}
+
+
+void NoSweat::ConfigFileWatcher::remove_directory_watch(const std::string& directory) {
+    auto it = directories_.find(directory);
+    if (it == directories_.end() || --it->second.second > 0)
+        return;
+#ifdef NOSWEAT_HAVE_INOTIFY
+    if (inotify_fd_ >= 0 && it->second.first >= 0)
+        inotify_rm_watch(inotify_fd_, it->second.first);
+#endif
+    directories_.erase(it);
+}
+
+#endif
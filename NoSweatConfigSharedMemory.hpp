@@ -0,0 +1,541 @@
+/*****************************************************************************
+Copyright (c) 2012 Lion Krischer (krischer@geophysik.uni-muenchen.de)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+/// @file NoSweatConfigSharedMemory.hpp
+///
+/// Optional sharing of parsed configurations between processes through
+/// POSIX shared memory. Needs a POSIX system.
+
+#ifndef __NOSWEAT_CONFIG_SHARED_MEMORY__
+#define __NOSWEAT_CONFIG_SHARED_MEMORY__
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NoSweatConfigFileParser.hpp"
+
+namespace NoSweat {
+    // Identifies shared memory objects and the version of their layout.
+    static const char shared_memory_magic[8] = {'N', 'S', 'W', 'S', 'H', 'M', 'E', 'M'};
+    static const std::uint32_t shared_memory_version = 1;
+
+    /// A shared memory object holding the keys and values of a parser. It
+    /// consists of a Header, the Entries of all keys, a hash table of Slots
+    /// finding them, the keys, one Value per key and the strings and array
+    /// elements of the values. Only the values and their strings change once
+    /// the object has been created. They are guarded by a sequence lock: the
+    /// sequence number is odd while they are written, and readers copy a
+    /// value again if the number was odd or has changed in the meantime.
+    class SharedConfigRegion {
+        public:
+            struct Header {
+                char magic[8];
+                std::uint32_t version;
+                // To detect objects created by a process with another byte order.
+                std::uint32_t byte_order;
+                std::uint64_t size;
+                std::uint32_t entry_count;
+                // A power of two.
+                std::uint32_t slot_count;
+                // Areas, relative to the start of the object.
+                std::uint64_t entries_offset;
+                std::uint64_t slots_offset;
+                std::uint64_t keys_offset;
+                std::uint64_t values_offset;
+                std::uint64_t strings_offset;
+                std::uint64_t strings_capacity;
+                // Set once everything but the values is written and never changed afterwards.
+                std::atomic<std::uint32_t> is_ready;
+                std::uint32_t reserved;
+                // Incremented before and after the values are written.
+                std::atomic<std::uint64_t> sequence;
+            };
+            struct Entry {
+                // Relative to the keys. Keys of sections are stored as "section.key".
+                std::uint64_t key_offset;
+                std::uint32_t key_size;
+                std::uint32_t section_size;
+                std::uint32_t type;
+                std::uint32_t reserved;
+            };
+            // Same as in ValueStore: empty slots have an entry index of zero,
+            // all others the index plus one. Slots finding keys of sections
+            // by their key alone have alias_bit set in addition.
+            struct Slot {
+                std::uint32_t hash;
+                std::uint32_t entry;
+            };
+            static const std::uint32_t alias_bit = 0x80000000u;
+            // Values are stored as in the binary cache, strings relative to the strings area.
+            typedef NoSweatConfigFileParser::CacheValue Value;
+
+            SharedConfigRegion() : data_(nullptr), size_(0) {}
+            inline ~SharedConfigRegion();
+            // Create the object for the keys of the parser with its current
+            // values, replacing an existing object of that name.
+            inline bool create(const std::string& name, const NoSweatConfigFileParser& parser,
+                               std::size_t strings_capacity);
+            // Map an existing object read-only. Return false if it does not
+            // exist, is not completely created yet or is not valid.
+            inline bool open(const std::string& name);
+            bool is_open() const { return data_ != nullptr; }
+            // Index of the entry of the key, or UINT32_MAX.
+            inline std::uint32_t find(StringRef key) const;
+            // Copy the value of the entry if it has the type of T. Return
+            // false and leave result unchanged if the value is still being
+            // written after read_timeout(), e.g. because the publisher died
+            // while writing.
+            template<typename T>
+            inline bool read(std::uint32_t index, typename ValueTraits<T>::value_type& result) const;
+            // Replace all values with the current values of the parser.
+            // Return false if its keys differ from the ones of the object or
+            // if the strings do not fit. Only one process may write.
+            inline bool write(const NoSweatConfigFileParser& parser);
+            // Number of writes since the object has been created.
+            std::uint64_t version() const { return header().sequence.load(std::memory_order_acquire) / 2; }
+            // How long read() waits for a value that is being written.
+            static std::chrono::milliseconds read_timeout() { return std::chrono::milliseconds(1000); }
+
+        private:
+            SharedConfigRegion(const SharedConfigRegion&);
+            SharedConfigRegion& operator=(const SharedConfigRegion&);
+
+            static const std::uint64_t alignment = 8;
+            static std::uint64_t align(std::uint64_t offset) { return (offset + alignment - 1) & ~(alignment - 1); }
+            // Encode the current values of the parser as in the binary cache.
+            static inline void encode_values(const NoSweatConfigFileParser& parser, std::vector<Value>& values,
+                                             std::string& strings);
+            // Whether the parser has the keys and types of the object.
+            inline bool has_keys_of(const NoSweatConfigFileParser& parser) const;
+            // Check all offsets, so reading never leaves the object.
+            inline bool is_valid() const;
+            inline void unmap();
+
+            const Header& header() const { return *reinterpret_cast<const Header*>(data_); }
+            Header& header() { return *reinterpret_cast<Header*>(data_); }
+            const Entry* entries() const { return reinterpret_cast<const Entry*>(data_ + header().entries_offset); }
+            const Slot* slots() const { return reinterpret_cast<const Slot*>(data_ + header().slots_offset); }
+            const char* keys() const { return data_ + header().keys_offset; }
+            StringRef qualified_key(const Entry& entry) const {
+                return StringRef(keys() + entry.key_offset, entry.key_size);
+            }
+            // The key a slot is found by.
+            StringRef slot_key(const Slot& slot) const {
+                const Entry& entry = entries()[(slot.entry & ~alias_bit) - 1];
+                const StringRef key = qualified_key(entry);
+                return slot.entry & alias_bit ? StringRef(key.data() + entry.section_size + 1,
+                                                          key.size() - entry.section_size - 1) : key;
+            }
+
+            char* data_;
+            std::size_t size_;
+    };
+
+    /// Publishes the values of a parser to a shared memory object, so that
+    /// other processes read them without parsing the files themselves. One
+    /// process, e.g. the one loading and reloading the configuration, is
+    /// the publisher of an object.
+    class SharedConfigPublisher {
+        public:
+            // Create the shared memory object name, e.g. "/myapp.config", for
+            // the keys of the parser and publish its current values. An
+            // existing object of that name is replaced; readers attached to
+            // it keep reading its last values. The strings and array elements
+            // of all values share strings_capacity bytes, by default twice
+            // their current size plus 64 kB.
+            inline SharedConfigPublisher(const std::string& name, const NoSweatConfigFileParser& parser,
+                                         std::size_t strings_capacity = 0);
+            // False if the object could not be created.
+            bool is_open() const { return region_.is_open(); }
+            // Publish the current values of the parser, e.g. after reading a
+            // configuration file. Return false if the parser does not have the
+            // same keys as the one the object was created for or if the
+            // strings do not fit.
+            inline bool publish(const NoSweatConfigFileParser& parser);
+            // Remove the name. Attached readers keep reading the last values.
+            inline bool unlink();
+
+        private:
+            std::string name_;
+            SharedConfigRegion region_;
+            std::mutex mutex_;
+    };
+
+    /// Reads the values published to a shared memory object. Every value is
+    /// copied out of the object, and read again if it has been published
+    /// meanwhile, so reading never blocks the publisher and never returns a
+    /// partially published value. Values of different keys may come from
+    /// different publications; compare version() before and after reading
+    /// them to detect that. As with a parser, unknown keys and keys of
+    /// another type return the default value of the type, and so do values
+    /// that are still being written after a second, which only happens if
+    /// the publisher died while writing them.
+    class SharedConfigReader {
+        public:
+            inline explicit SharedConfigReader(const std::string& name);
+            // False if the object does not exist (yet) or is not valid.
+            bool is_open() const { return region_.is_open(); }
+            int get_int(StringRef key) const { return get_value<int>(key); }
+            float get_float(StringRef key) const { return get_value<float>(key); }
+            std::string get_string(StringRef key) const { return get_value<std::string>(key); }
+            bool get_bool(StringRef key) const { return get_value<bool>(key); }
+            std::int64_t get_int64(StringRef key) const { return get_value<std::int64_t>(key); }
+            double get_double(StringRef key) const { return get_value<double>(key); }
+            std::vector<int> get_int_array(StringRef key) const { return get_value<std::vector<int>>(key); }
+            std::vector<float> get_float_array(StringRef key) const { return get_value<std::vector<float>>(key); }
+            std::vector<std::int64_t> get_int64_array(StringRef key) const {
+                return get_value<std::vector<std::int64_t>>(key);
+            }
+            std::vector<double> get_double_array(StringRef key) const {
+                return get_value<std::vector<double>>(key);
+            }
+            // Incremented with every publication.
+            std::uint64_t version() const { return region_.is_open() ? region_.version() : 0; }
+
+        private:
+            template<typename T>
+            typename ValueTraits<T>::value_type get_value(StringRef key) const {
+                typename ValueTraits<T>::value_type result = typename ValueTraits<T>::value_type();
+                if (region_.is_open())
+                    region_.read<T>(region_.find(key), result);
+                return result;
+            }
+
+            SharedConfigRegion region_;
+    };
+}
+
+
+NoSweat::SharedConfigRegion::~SharedConfigRegion() {
+    unmap();
+}
+
+
+/// The keys and the hash table are laid out in memory first, so the
+/// object is only created once its size is known. Readers do not attach
+/// before is_ready is set.
+bool NoSweat::SharedConfigRegion::create(const std::string& name, const NoSweatConfigFileParser& parser,
+                                         std::size_t strings_capacity) {
+    unmap();
+    const ValueStore& store = parser.values_;
+    std::vector<Entry> entries;
+    entries.reserve(store.size());
+    std::string keys;
+    // Hashes and entries of the slots to fill.
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> slot_entries;
+    for (const ConfigEntry& entry: store.entries()) {
+        const StringRef qualified_key = entry.qualified_key();
+        Entry shared_entry = Entry();
+        shared_entry.key_offset = keys.size();
+        shared_entry.key_size = static_cast<std::uint32_t>(qualified_key.size());
+        shared_entry.section_size = entry.section_size;
+        shared_entry.type = static_cast<std::uint32_t>(entry.type);
+        entries.push_back(shared_entry);
+        keys.append(qualified_key.data(), qualified_key.size());
+        slot_entries.push_back(std::make_pair(hash_key(qualified_key), entry.id + 1));
+        // Keys of sections are found by their key alone where the parser finds them.
+        if (entry.section_size && store.find(entry.key) == &entry)
+            slot_entries.push_back(std::make_pair(hash_key(entry.key), (entry.id + 1) | alias_bit));
+    }
+    std::uint32_t slot_count = 16;
+    while (slot_count < 2 * slot_entries.size())
+        slot_count *= 2;
+    std::vector<Value> values;
+    std::string strings;
+    encode_values(parser, values, strings);
+    if (!strings_capacity)
+        strings_capacity = 2 * strings.size() + (1 << 16);
+    else if (strings_capacity < strings.size())
+        strings_capacity = strings.size();
+
+    const std::uint64_t entries_offset = align(sizeof(Header));
+    const std::uint64_t slots_offset = align(entries_offset + entries.size() * sizeof(Entry));
+    const std::uint64_t keys_offset = align(slots_offset + std::uint64_t(slot_count) * sizeof(Slot));
+    const std::uint64_t values_offset = align(keys_offset + keys.size());
+    const std::uint64_t strings_offset = align(values_offset + values.size() * sizeof(Value));
+    const std::uint64_t size = strings_offset + align(strings_capacity);
+
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return false;
+    void* data = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+        data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    data_ = static_cast<char*>(data);
+    size_ = size;
+
+    // The object is zero-filled, so is_ready and sequence start at zero.
+    Header& shared_header = *new (data_) Header();
+    std::memcpy(shared_header.magic, shared_memory_magic, sizeof(shared_header.magic));
+    shared_header.version = shared_memory_version;
+    shared_header.byte_order = cache_byte_order;
+    shared_header.size = size;
+    shared_header.entry_count = static_cast<std::uint32_t>(entries.size());
+    shared_header.slot_count = slot_count;
+    shared_header.entries_offset = entries_offset;
+    shared_header.slots_offset = slots_offset;
+    shared_header.keys_offset = keys_offset;
+    shared_header.values_offset = values_offset;
+    shared_header.strings_offset = strings_offset;
+    shared_header.strings_capacity = align(strings_capacity);
+    if (!entries.empty())
+        std::memcpy(data_ + shared_header.entries_offset, entries.data(), entries.size() * sizeof(Entry));
+    std::memcpy(data_ + shared_header.keys_offset, keys.data(), keys.size());
+    Slot* slots = reinterpret_cast<Slot*>(data_ + shared_header.slots_offset);
+    const std::size_t mask = slot_count - 1;
+    for (const auto& slot_entry: slot_entries) {
+        std::size_t index = slot_entry.first & mask;
+        while (slots[index].entry)
+            index = (index + 1) & mask;
+        slots[index].hash = static_cast<std::uint32_t>(slot_entry.first >> 32);
+        slots[index].entry = slot_entry.second;
+    }
+    if (!values.empty())
+        std::memcpy(data_ + shared_header.values_offset, values.data(), values.size() * sizeof(Value));
+    std::memcpy(data_ + shared_header.strings_offset, strings.data(), strings.size());
+    shared_header.is_ready.store(1, std::memory_order_release);
+    return true;
+}
+
+
+bool NoSweat::SharedConfigRegion::open(const std::string& name) {
+    unmap();
+    const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat status;
+    void* data = MAP_FAILED;
+    if (::fstat(fd, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(Header)))
+        data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    data_ = static_cast<char*>(data);
+    size_ = static_cast<std::size_t>(status.st_size);
+    if (!is_valid()) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+
+std::uint32_t NoSweat::SharedConfigRegion::find(StringRef key) const {
+    const std::uint64_t hash = hash_key(key);
+    const std::uint32_t short_hash = static_cast<std::uint32_t>(hash >> 32);
+    const std::size_t mask = header().slot_count - 1;
+    const Slot* slots = this->slots();
+    // Linear probing. is_valid() made sure there is an empty slot.
+    for (std::size_t index = hash & mask; ; index = (index + 1) & mask) {
+        const Slot& slot = slots[index];
+        if (!slot.entry)
+            return UINT32_MAX;
+        if (slot.hash == short_hash && slot_key(slot) == key)
+            return (slot.entry & ~alias_bit) - 1;
+    }
+}
+
+
+/// Torn values may point anywhere, so strings and arrays are only copied
+/// after checking their bounds. Values read while they are written are
+/// discarded once the sequence number shows it. A publication takes
+/// microseconds, so the clock is only read once a copy has been discarded.
+template<typename T>
+bool NoSweat::SharedConfigRegion::read(std::uint32_t index, typename ValueTraits<T>::value_type& result) const {
+    const Header& header = this->header();
+    if (index >= header.entry_count || static_cast<ValueType>(entries()[index].type) != ValueTraits<T>::type)
+        return false;
+    const ValueType type = ValueTraits<T>::type;
+    const Value* values = reinterpret_cast<const Value*>(data_ + header.values_offset);
+    const char* strings = data_ + header.strings_offset;
+    const std::size_t element_size = array_element_size(type);
+    typename ValueTraits<T>::value_type copy = typename ValueTraits<T>::value_type();
+    std::chrono::steady_clock::time_point deadline;
+    for (bool is_retry = false;; is_retry = true) {
+        const std::uint64_t sequence = header.sequence.load(std::memory_order_acquire);
+        if (!(sequence & 1)) {
+            Value value;
+            std::memcpy(&value, &values[index], sizeof(value));
+            const std::uint64_t size = element_size ? std::uint64_t(value.string_size) * element_size :
+                value.string_size;
+            const bool is_valid = value.string_offset <= header.strings_capacity &&
+                size <= header.strings_capacity - value.string_offset &&
+                (!element_size || value.string_offset % alignof(double) == 0);
+            if (is_valid)
+                copy = typename ValueTraits<T>::value_type(
+                    ValueTraits<T>::get(NoSweatConfigFileParser::cached_value(type, value, strings)));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header.sequence.load(std::memory_order_relaxed) == sequence) {
+                if (is_valid)
+                    result = std::move(copy);
+                return is_valid;
+            }
+        }
+        if (!is_retry)
+            deadline = std::chrono::steady_clock::now() + read_timeout();
+        else if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::yield();
+    }
+}
+
+
+/// The values are encoded before the sequence lock is taken, so readers
+/// only wait for the copy.
+bool NoSweat::SharedConfigRegion::write(const NoSweatConfigFileParser& parser) {
+    if (!has_keys_of(parser))
+        return false;
+    std::vector<Value> values;
+    std::string strings;
+    encode_values(parser, values, strings);
+    Header& header = this->header();
+    if (strings.size() > header.strings_capacity)
+        return false;
+    const std::uint64_t sequence = header.sequence.load(std::memory_order_relaxed);
+    header.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (!values.empty())
+        std::memcpy(data_ + header.values_offset, values.data(), values.size() * sizeof(Value));
+    std::memcpy(data_ + header.strings_offset, strings.data(), strings.size());
+    header.sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+
+void NoSweat::SharedConfigRegion::encode_values(const NoSweatConfigFileParser& parser, std::vector<Value>& values,
+                                                std::string& strings) {
+    SnapshotPointer::ReadGuard guard{*parser.snapshots_};
+    values.reserve(parser.values_.size());
+    for (const ConfigEntry& entry: parser.values_.entries())
+        values.push_back(NoSweatConfigFileParser::cache_value(entry.type, (*guard)[entry.id], strings));
+}
+
+
+bool NoSweat::SharedConfigRegion::has_keys_of(const NoSweatConfigFileParser& parser) const {
+    if (parser.values_.size() != header().entry_count)
+        return false;
+    const Entry* entries = this->entries();
+    for (const ConfigEntry& entry: parser.values_.entries()) {
+        if (static_cast<ValueType>(entries[entry.id].type) != entry.type ||
+            qualified_key(entries[entry.id]) != entry.qualified_key())
+            return false;
+    }
+    return true;
+}
+
+
+bool NoSweat::SharedConfigRegion::is_valid() const {
+    const Header& header = this->header();
+    if (!header.is_ready.load(std::memory_order_acquire) || !header.sequence.is_lock_free() ||
+        std::memcmp(header.magic, shared_memory_magic, sizeof(header.magic)) != 0 ||
+        header.version != shared_memory_version || header.byte_order != cache_byte_order || header.size != size_)
+        return false;
+    // Every area has to be aligned and to end before the next one starts.
+    const std::uint64_t areas[][2] = {
+        {header.entries_offset, std::uint64_t(header.entry_count) * sizeof(Entry)},
+        {header.slots_offset, std::uint64_t(header.slot_count) * sizeof(Slot)},
+        {header.keys_offset, 0},
+        {header.values_offset, std::uint64_t(header.entry_count) * sizeof(Value)},
+        {header.strings_offset, header.strings_capacity}};
+    std::uint64_t end = sizeof(Header);
+    for (const auto& area: areas) {
+        if (area[0] % alignment || area[0] < end || area[0] > size_ || area[1] > size_ - area[0])
+            return false;
+        end = area[0] + area[1];
+    }
+    if (!header.slot_count || header.slot_count & (header.slot_count - 1))
+        return false;
+    const std::uint64_t keys_size = header.values_offset - header.keys_offset;
+    const Entry* entries = this->entries();
+    for (std::uint32_t i = 0; i < header.entry_count; i++) {
+        const Entry& entry = entries[i];
+        const ValueType type = static_cast<ValueType>(entry.type);
+        if (type == ValueType::Unknown || type > ValueType::DoubleArray || entry.key_offset > keys_size ||
+            entry.key_size > keys_size - entry.key_offset ||
+            (entry.section_size && entry.section_size >= entry.key_size))
+            return false;
+    }
+    std::uint32_t empty_slots = 0;
+    const Slot* slots = this->slots();
+    for (std::uint32_t i = 0; i < header.slot_count; i++) {
+        const std::uint32_t index = slots[i].entry & ~alias_bit;
+        if (!slots[i].entry)
+            empty_slots++;
+        else if (!index || index > header.entry_count ||
+                 ((slots[i].entry & alias_bit) && !entries[index - 1].section_size))
+            return false;
+    }
+    return empty_slots > 0;
+}
+
+
+void NoSweat::SharedConfigRegion::unmap() {
+    if (data_)
+        ::munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+
+NoSweat::SharedConfigPublisher::SharedConfigPublisher(const std::string& name, const NoSweatConfigFileParser& parser,
+                                                      std::size_t strings_capacity)
+: name_(name) {
+    region_.create(name, parser, strings_capacity);
+}
+
+
+bool NoSweat::SharedConfigPublisher::publish(const NoSweatConfigFileParser& parser) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return region_.is_open() && region_.write(parser);
+}
+
+
+bool NoSweat::SharedConfigPublisher::unlink() {
+    return ::shm_unlink(name_.c_str()) == 0;
+}
+
+
+NoSweat::SharedConfigReader::SharedConfigReader(const std::string& name) {
+    region_.open(name);
+}
+
+#endif
@@ -0,0 +1,475 @@
+/// @file benchmark_nosweatconfigfileparser.cpp
+///
+/// Generates synthetic default and user configuration files and measures
+/// - the throughput of splitting them into lines and assignments, comparing
+///   the std::getline() based reading the parser used before with the line
+///   scanner in all available instruction sets,
+/// - the throughput of parsing and reading them, with the allocations per
+///   line and the peak resident set size,
+/// - the latency percentiles of get_*(), handle and key id reads.
+///
+/// Usage: ./benchmark_nosweatconfigfileparser [options]
+///   --size=MB              Size of the default configuration file (64).
+///   --key-length=MIN:MAX   Uniformly distributed key lengths (8:32).
+///   --types=I:F:S:B:L:D    Weights of int, float, string, bool, int64 and
+///                          double lines (3:2:2:1:1:1).
+///   --error-rate=R         Fraction of lines that are invalid (0.01).
+///   --comment-rate=R       Fraction of comment and group lines (0.05).
+///   --override-rate=R      Fraction of keys set in the user file (0.1).
+///   --lookups=N            Number of timed reads per accessor (200000).
+///   --threads=N            Parser threads, 0 for one per core (1).
+///   --seed=N               Seed of the generator (1).
+///   --json                 Print a single JSON object instead of text.
+///   --keep                 Keep the generated files.
+/// A single number is taken as --size for compatibility.
+
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include "NoSweatConfigFileParser.hpp"
+
+using namespace NoSweat;
+
+
+static const char* synthetic_default_config_file = "benchmark_default_config.cfg";
+static const char* synthetic_config_file = "benchmark_config.cfg";
+static const char* empty_config_file = "benchmark_empty_config.cfg";
+
+
+// Count all heap allocations of the process.
+static std::atomic<std::size_t> allocation_count{0};
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+// The deallocation functions are not inlined, as GCC would otherwise pair
+// free() with a call to operator new and warn about the mismatch.
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+
+struct Options {
+    double megabytes = 64;
+    unsigned min_key_length = 8;
+    unsigned max_key_length = 32;
+    // int, float, string, bool, int64, double
+    std::vector<double> type_weights{3, 2, 2, 1, 1, 1};
+    double error_rate = 0.01;
+    double comment_rate = 0.05;
+    double override_rate = 0.1;
+    std::size_t lookups = 200000;
+    unsigned threads = 1;
+    unsigned seed = 1;
+    bool json = false;
+    bool keep = false;
+};
+
+
+static bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        const std::size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+        if (name == "--size" || (argc == 2 && std::isdigit(static_cast<unsigned char>(argument[0]))))
+            options.megabytes = std::atof(name == "--size" ? value.c_str() : argument.c_str());
+        else if (name == "--key-length")
+            std::sscanf(value.c_str(), "%u:%u", &options.min_key_length, &options.max_key_length);
+        else if (name == "--types")
+            std::sscanf(value.c_str(), "%lf:%lf:%lf:%lf:%lf:%lf", &options.type_weights[0], &options.type_weights[1],
+                        &options.type_weights[2], &options.type_weights[3], &options.type_weights[4],
+                        &options.type_weights[5]);
+        else if (name == "--error-rate")
+            options.error_rate = std::atof(value.c_str());
+        else if (name == "--comment-rate")
+            options.comment_rate = std::atof(value.c_str());
+        else if (name == "--override-rate")
+            options.override_rate = std::atof(value.c_str());
+        else if (name == "--lookups")
+            options.lookups = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--threads")
+            options.threads = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--seed")
+            options.seed = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--json")
+            options.json = true;
+        else if (name == "--keep")
+            options.keep = true;
+        else
+            return false;
+    }
+    options.min_key_length = std::max(1u, options.min_key_length);
+    options.max_key_length = std::max(options.min_key_length, options.max_key_length);
+    return true;
+}
+
+
+// The keys of the valid lines of the generated default file by type.
+struct GeneratedKeys {
+    std::vector<std::string> keys[6];
+};
+
+
+/// Writes the default and the user configuration file. Keys are unique,
+/// because they end with their number.
+class ConfigGenerator {
+    public:
+        ConfigGenerator(const Options& options)
+        : options_(options), random_(options.seed),
+          types_(options.type_weights.begin(), options.type_weights.end()) {}
+
+        std::size_t write_default_config(const std::string& path, GeneratedKeys& generated_keys) {
+            static const char* keywords[] = {"int", "float", "string", "bool", "int64", "double"};
+            std::ofstream file_stream{path};
+            std::string line;
+            std::size_t written = 0;
+            for (std::size_t i = 0; written < options_.megabytes * 1e6; i++) {
+                if (chance(options_.comment_rate)) {
+                    line = i % 8 ? "# A comment describing the next value\n" : "[group " + std::to_string(i) + "]\n";
+                }
+                else {
+                    const int type = types_(random_);
+                    const std::string key = generate_key(i);
+                    line = keywords[type] + (" " + key) + " = ";
+                    if (chance(options_.error_rate)) {
+                        line += invalid_value(type);
+                    }
+                    else {
+                        line += value(type);
+                        generated_keys.keys[type].push_back(key);
+                    }
+                    line += "\n";
+                }
+                file_stream << line;
+                written += line.size();
+            }
+            return written;
+        }
+
+        std::size_t write_config(const std::string& path, const GeneratedKeys& generated_keys) {
+            std::ofstream file_stream{path};
+            std::string line;
+            std::size_t written = 0;
+            for (int type = 0; type < 6; type++) {
+                for (const std::string& key: generated_keys.keys[type]) {
+                    if (!chance(options_.override_rate))
+                        continue;
+                    if (chance(options_.error_rate))
+                        line = key + " = " + invalid_value(type) + "\n";
+                    else
+                        line = key + " = " + value(type) + "\n";
+                    file_stream << line;
+                    written += line.size();
+                }
+            }
+            return written;
+        }
+
+    private:
+        bool chance(double rate) { return std::uniform_real_distribution<double>(0, 1)(random_) < rate; }
+
+        std::string generate_key(std::size_t number) {
+            static const char characters[] = "abcdefghijklmnopqrstuvwxyz_ ";
+            const std::string suffix = "_" + std::to_string(number);
+            const std::size_t length = std::uniform_int_distribution<unsigned>(
+                options_.min_key_length, options_.max_key_length)(random_);
+            std::string key;
+            key += characters[random_() % 26];
+            while (key.size() + suffix.size() < length)
+                key += characters[random_() % (sizeof(characters) - 1)];
+            return key + suffix;
+        }
+
+        std::string value(int type) {
+            static const char* booleans[] = {"true", "no", "On", "0", "yes", "OFF"};
+            char buffer[64];
+            switch (type) {
+                case 0: return std::to_string(static_cast<int>(random_()));
+                case 1: std::snprintf(buffer, sizeof(buffer), "%.3f", (random_() % 100000) / 7.0); return buffer;
+                case 2: return "/usr/local/share/some/path/" + std::to_string(random_() % 1000);
+                case 3: return booleans[random_() % 6];
+                case 4: return std::to_string(static_cast<std::int64_t>(random_() * 1000003ull));
+                default: std::snprintf(buffer, sizeof(buffer), "%.15g", (random_() % 1000000) / 13.0); return buffer;
+            }
+        }
+
+        // Values that do not convert to the type, except for strings, which
+        // are invalid without value.
+        std::string invalid_value(int type) {
+            return type == 2 ? "" : type == 3 ? "maybe" : "12abc";
+        }
+
+        const Options& options_;
+        std::mt19937_64 random_;
+        std::discrete_distribution<int> types_;
+};
+
+
+// Best throughput in MB/s out of a few runs.
+template<typename Function>
+static double megabytes_per_second(std::size_t size, Function function) {
+    double best = 0.0;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::max(best, size / 1e6 / elapsed.count());
+    }
+    return best;
+}
+
+
+// Heap allocations of a single call.
+template<typename Function>
+static std::size_t allocations(Function function) {
+    const std::size_t before = allocation_count.load();
+    function();
+    return allocation_count.load() - before;
+}
+
+
+static std::size_t count_lines(const std::string& path) {
+    MappedFile file{path};
+    return std::count(file.data(), file.data() + file.size(), '\n');
+}
+
+
+// Count the lines with an assignment operator the way the parser did before,
+// reading line by line with std::getline().
+static std::size_t count_assignments_getline(const std::string& path) {
+    std::ifstream file_stream{path};
+    std::string current_line;
+    std::size_t count = 0;
+    while (file_stream.good()) {
+        std::getline(file_stream, current_line);
+        trim(current_line);
+        if (current_line.find_first_of(":=") != std::string::npos)
+            count++;
+    }
+    return count;
+}
+
+
+static std::size_t count_assignments_scanner(const std::string& path, SimdLevel simd_level) {
+    MappedFile file{path};
+    LineScanner scanner{file.data(), file.size(), simd_level};
+    StringRef line;
+    std::size_t assignment_index;
+    std::size_t count = 0;
+    while (scanner.next(line, assignment_index)) {
+        line = trim_line(line, assignment_index);
+        if (assignment_index != std::string::npos)
+            count++;
+    }
+    return count;
+}
+
+
+// A parser with the values of the generated default file. Starts from an
+// empty default file, so the parser threads apply to the default file, too.
+static std::unique_ptr<NoSweatConfigFileParser> parse_default_config(unsigned threads) {
+    std::unique_ptr<NoSweatConfigFileParser> config_parser{new NoSweatConfigFileParser(empty_config_file)};
+    config_parser->set_parser_threads(threads);
+    MappedFile file{synthetic_default_config_file};
+    config_parser->parse_default_config_buffer(file.data(), file.size());
+    return config_parser;
+}
+
+
+struct Percentiles {
+    double p50, p90, p99, p999, max;
+};
+
+
+/// Times every read on its own and subtracts the overhead of reading the
+/// clock, so the percentiles are in nanoseconds per read.
+template<typename Read>
+static Percentiles latency_percentiles(std::size_t count, Read read) {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<double> overheads(1000);
+    for (double& overhead: overheads) {
+        const Clock::time_point start = Clock::now();
+        overhead = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    std::sort(overheads.begin(), overheads.end());
+    const double clock_overhead = overheads[overheads.size() / 2];
+
+    std::vector<double> latencies(count);
+    for (std::size_t i = 0; i < count; i++) {
+        const Clock::time_point start = Clock::now();
+        read(i);
+        latencies[i] = std::max(0.0, std::chrono::duration<double, std::nano>(Clock::now() - start).count() -
+                                     clock_overhead);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double fraction) { return latencies[std::min(count - 1, std::size_t(fraction * count))]; };
+    return Percentiles{at(0.5), at(0.9), at(0.99), at(0.999), latencies.back()};
+}
+
+
+// Keeps reads from being optimized away.
+static volatile std::size_t sink;
+
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Unknown option. See the top of benchmark_nosweatconfigfileparser.cpp for the usage." << std::endl;
+        return 1;
+    }
+    GeneratedKeys generated_keys;
+    ConfigGenerator generator{options};
+    const std::size_t default_size = generator.write_default_config(synthetic_default_config_file, generated_keys);
+    const std::size_t size = generator.write_config(synthetic_config_file, generated_keys);
+    std::ofstream{empty_config_file};
+    const std::size_t default_lines = count_lines(synthetic_default_config_file);
+    const std::size_t lines = std::max<std::size_t>(1, count_lines(synthetic_config_file));
+
+    // Line scanning.
+    const std::size_t expected = count_assignments_getline(synthetic_default_config_file);
+    const double getline_throughput = megabytes_per_second(default_size, [&]() {
+        count_assignments_getline(synthetic_default_config_file); });
+    double scanner_throughput[3] = {0, 0, 0};
+    for (SimdLevel simd_level: {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (simd_level > detected_simd_level())
+            continue;
+        if (count_assignments_scanner(synthetic_default_config_file, simd_level) != expected) {
+            std::cerr << "FAILURE: Line scanner results differ from std::getline()." << std::endl;
+            return 1;
+        }
+        scanner_throughput[static_cast<int>(simd_level)] = megabytes_per_second(default_size, [&]() {
+            count_assignments_scanner(synthetic_default_config_file, simd_level); });
+    }
+
+    // Parsing.
+    const double default_throughput = megabytes_per_second(default_size, [&]() {
+        parse_default_config(options.threads); });
+    std::unique_ptr<NoSweatConfigFileParser> config_parser;
+    const std::size_t default_allocations = allocations([&]() { config_parser = parse_default_config(options.threads); });
+    // Reading a buffer parses all lines, while reading the same file again
+    // would only parse the changed lines.
+    MappedFile config_file{synthetic_config_file};
+    const std::size_t read_allocations = allocations([&]() {
+        config_parser->read_config_buffer(config_file.data(), config_file.size()); });
+    const double throughput = megabytes_per_second(size, [&]() {
+        config_parser->read_config_buffer(config_file.data(), config_file.size()); });
+
+    // Emitting all values.
+    std::vector<char> emitted(config_parser->emit_configuration(nullptr, 0));
+    const double emit_throughput = megabytes_per_second(emitted.size(), [&]() {
+        config_parser->emit_configuration(emitted.data(), emitted.size()); });
+
+    // Reading values.
+    std::mt19937_64 random{options.seed};
+    const std::string missing_key = "missing key";
+    auto random_keys = [&](const std::vector<std::string>& keys) {
+        std::vector<const std::string*> picked(options.lookups);
+        for (const std::string*& key: picked)
+            key = keys.empty() ? &missing_key : &keys[random() % keys.size()];
+        return picked;
+    };
+    const std::vector<const std::string*> int_keys = random_keys(generated_keys.keys[0]);
+    const std::vector<const std::string*> float_keys = random_keys(generated_keys.keys[1]);
+    const std::vector<const std::string*> string_keys = random_keys(generated_keys.keys[2]);
+    const std::vector<const std::string*> bool_keys = random_keys(generated_keys.keys[3]);
+    std::vector<Handle<int>> handles;
+    std::vector<KeyId> key_ids;
+    for (const std::string* key: int_keys) {
+        handles.push_back(config_parser->get_handle<int>(*key));
+        key_ids.push_back(config_parser->key_id(*key));
+    }
+    const NoSweatConfigFileParser& parser = *config_parser;
+    const char* accessor_names[] = {"get_int", "get_float", "get_string", "get_bool", "handle", "key id"};
+    const int accessor_count = sizeof(accessor_names) / sizeof(accessor_names[0]);
+    const Percentiles latencies[] = {
+        latency_percentiles(options.lookups, [&](std::size_t i) { sink = parser.get_int(*int_keys[i]); }),
+        latency_percentiles(options.lookups, [&](std::size_t i) { sink = parser.get_float(*float_keys[i]); }),
+        latency_percentiles(options.lookups, [&](std::size_t i) { sink = parser.get_string(*string_keys[i]).size(); }),
+        latency_percentiles(options.lookups, [&](std::size_t i) { sink = parser.get_bool(*bool_keys[i]); }),
+        latency_percentiles(options.lookups, [&](std::size_t i) { sink = handles[i].get(); }),
+        latency_percentiles(options.lookups, [&](std::size_t i) { sink = parser.get_int(key_ids[i]); })};
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const long peak_rss_kb = usage.ru_maxrss;
+
+    const char* simd_names[] = {"scalar", "sse2", "avx2"};
+    if (options.json) {
+        std::printf("{\"options\": {\"size_mb\": %g, \"min_key_length\": %u, \"max_key_length\": %u, "
+                    "\"type_weights\": [%g, %g, %g, %g, %g, %g], \"error_rate\": %g, \"comment_rate\": %g, "
+                    "\"override_rate\": %g, \"lookups\": %zu, \"threads\": %u, \"seed\": %u},\n",
+                    options.megabytes, options.min_key_length, options.max_key_length, options.type_weights[0],
+                    options.type_weights[1], options.type_weights[2], options.type_weights[3],
+                    options.type_weights[4], options.type_weights[5], options.error_rate, options.comment_rate,
+                    options.override_rate, options.lookups, options.threads, options.seed);
+        std::printf(" \"scan_mb_per_s\": {\"getline\": %.1f", getline_throughput);
+        for (int i = 0; i < 3; i++) {
+            if (scanner_throughput[i] > 0)
+                std::printf(", \"%s\": %.1f", simd_names[i], scanner_throughput[i]);
+        }
+        std::printf("},\n");
+        std::printf(" \"default_config\": {\"bytes\": %zu, \"lines\": %zu, \"parse_mb_per_s\": %.1f, "
+                    "\"allocations_per_line\": %.3f},\n", default_size, default_lines, default_throughput,
+                    double(default_allocations) / default_lines);
+        std::printf(" \"config\": {\"bytes\": %zu, \"lines\": %zu, \"read_mb_per_s\": %.1f, "
+                    "\"allocations_per_line\": %.3f, \"emit_mb_per_s\": %.1f},\n", size, lines, throughput,
+                    double(read_allocations) / lines, emit_throughput);
+        std::printf(" \"lookup_ns\": {");
+        for (int i = 0; i < accessor_count; i++) {
+            std::printf("%s\"%s\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+                        i ? ", " : "", accessor_names[i], latencies[i].p50, latencies[i].p90, latencies[i].p99,
+                        latencies[i].p999, latencies[i].max);
+        }
+        std::printf("},\n \"peak_rss_kb\": %ld}\n", peak_rss_kb);
+    }
+    else {
+        std::printf("Synthetic default configuration file: %.1f MB, %zu lines\n", default_size / 1e6, default_lines);
+        std::printf("Synthetic configuration file:         %.1f MB, %zu lines\n", size / 1e6, lines);
+        std::printf("std::getline():           %8.1f MB/s\n", getline_throughput);
+        for (int i = 0; i < 3; i++) {
+            if (scanner_throughput[i] > 0)
+                std::printf("LineScanner (%s):%*s%8.1f MB/s\n", simd_names[i], int(11 - std::strlen(simd_names[i])),
+                            "", scanner_throughput[i]);
+        }
+        std::printf("Default file parse:       %8.1f MB/s, %.3f allocations per line\n", default_throughput,
+                    double(default_allocations) / default_lines);
+        std::printf("Configuration file read:  %8.1f MB/s, %.3f allocations per line\n", throughput,
+                    double(read_allocations) / lines);
+        std::printf("Configuration emit:       %8.1f MB/s\n", emit_throughput);
+        std::printf("Read latency in ns:            p50      p90      p99     p999      max\n");
+        for (int i = 0; i < accessor_count; i++) {
+            std::printf("  %-12s%*s%8.1f %8.1f %8.1f %8.1f %8.1f\n", accessor_names[i], 12, "", latencies[i].p50,
+                        latencies[i].p90, latencies[i].p99, latencies[i].p999, latencies[i].max);
+        }
+        std::printf("Peak resident set size:   %ld kB\n", peak_rss_kb);
+    }
+
+    if (!options.keep) {
+        std::remove(synthetic_default_config_file);
+        std::remove(synthetic_config_file);
+    }
+    std::remove(empty_config_file);
+}
@@ -4,11 +4,28 @@
 ///
 /// To keep it simple this is done without a unit testing framework.
 
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <sys/wait.h>
 #include "NoSweatConfigFileParser.hpp"
+#include "NoSweatConfigFileWatcher.hpp"
+#include "NoSweatConfigSharedMemory.hpp"
 
 using namespace NoSweat;
 
 
+// A schema for some of the keys of the default configuration file and a new one.
+#define TEST_SCHEMA(KEY) \
+    KEY(int, max_number_of_users, 0) \
+    KEY(float, movement_speed, 0.0) \
+    KEY(std::string, username, "") \
+    KEY(bool, use_accelerator, false) \
+    KEY(int, not_in_default_config, 42)
+NOSWEAT_CONFIG_SCHEMA(TestSchema, TEST_SCHEMA)
+static_assert(TestSchema::username_index == 2 && TestSchema::key_count == 5, "Schema indices");
+
+
 // Global test counters.
 static int tests_passed = 0;
 static int total_tests = 0;
@@ -122,7 +139,918 @@ int main() {
     assert_value<float>("high_prec_interval", config_parser_2.get_float("high_prec_interval"), 0.00002);
 
 
+
+    //////////
+    // Handles resolve a key once and always return the current value.
+    //////////
+    NoSweatConfigFileParser config_parser_3{"default_config.cfg"};
+    Handle<int> users_handle = config_parser_3.get_handle<int>("max_number_of_users");
+    Handle<float> speed_handle = config_parser_3.get_handle<float>("movement_speed");
+    Handle<std::string> username_handle = config_parser_3.get_handle<std::string>("username");
+    Handle<bool> accelerator_handle = config_parser_3.get_handle<bool>("use_accelerator");
+    assert_value<bool>("users_handle.is_valid()", users_handle.is_valid(), true);
+    assert_value<int>("max_number_of_users", users_handle.get(), 1);
+    assert_value<float>("movement_speed", speed_handle.get(), 12.34);
+    assert_value<std::string>("username", username_handle.get(), "some_user");
+    assert_value<bool>("use_accelerator", accelerator_handle.get(), true);
+
+    // Handles see values set after their resolution.
+    config_parser_3.read_config_file("config.cfg");
+    assert_value<int>("max_number_of_users", users_handle.get(), 22);
+    assert_value<float>("movement_speed", speed_handle.get(), 123.4);
+    assert_value<std::string>("username", username_handle.get(), "some_other_user");
+    assert_value<bool>("use_accelerator", accelerator_handle.get(), false);
+
+    // Unknown keys and wrong types result in invalid handles returning the type's default value.
+    Handle<int> missing_handle = config_parser_3.get_handle<int>("random stuff");
+    Handle<float> wrong_type_handle = config_parser_3.get_handle<float>("max_number_of_users");
+    assert_value<bool>("missing_handle.is_valid()", missing_handle.is_valid(), false);
+    assert_value<int>("random stuff", missing_handle.get(), 0);
+    assert_value<float>("max_number_of_users", wrong_type_handle.get(), 0.0);
+    assert_value<std::string>("random stuff", Handle<std::string>().get(), "");
+
+    // Keys are interned: ids are read without hashing, keys without copying.
+    const KeyId users_id = config_parser_3.key_id("max_number_of_users");
+    const std::string username_key{"username"};
+    assert_value<bool>("users_id.is_valid()", users_id.is_valid(), true);
+    assert_value<bool>("same id", config_parser_3.key_id(StringRef(username_key)) == config_parser_3.key_id("username"),
+                       true);
+    assert_value<std::string>("key_name", config_parser_3.key_name(users_id), "max_number_of_users");
+    assert_value<int>("max_number_of_users", config_parser_3.get_int(users_id), 22);
+    assert_value<std::string>("username", config_parser_3.get_string(config_parser_3.key_id(username_key)),
+                              "some_other_user");
+    assert_value<float>("max_number_of_users", config_parser_3.get_float(users_id), 0.0);
+    assert_value<bool>("random stuff id", config_parser_3.key_id("random stuff").is_valid(), false);
+    assert_value<int>("random stuff", config_parser_3.get_int(config_parser_3.key_id("random stuff")), 0);
+    assert_value<std::string>("invalid key_name", config_parser_3.key_name(KeyId()), "");
+    assert_value<std::string>("username", config_parser_3.get_string(StringRef(username_key)), "some_other_user");
+
+
+    //////////
+    // Parsing from memory buffers behaves exactly like parsing files.
+    //////////
+    NoSweatConfigFileParser config_parser_4{"default_config.cfg"};
+    const std::string default_buffer{"int buffer_int = 5\nfloat buffer_float: 2.5\r\nbool buffer_bool = Off\n"
+        "string buffer_string = a = b\nint buffer_int = 6\nint = 7"};
+    const std::string user_buffer{"buffer_int = 12abc\nfloat buffer_string = 1\nstring buffer_string =c"};
+    config_parser_4.parse_default_config_buffer(default_buffer.data(), default_buffer.size());
+    assert_value<int>("buffer_int", config_parser_4.get_int("buffer_int"), 5);
+    assert_value<float>("buffer_float", config_parser_4.get_float("buffer_float"), 2.5);
+    assert_value<bool>("buffer_bool", config_parser_4.get_bool("buffer_bool"), false);
+    assert_value<std::string>("buffer_string", config_parser_4.get_string("buffer_string"), "a = b");
+    // A line without a key name uses the type as key.
+    assert_value<int>("int", config_parser_4.get_int("int"), 7);
+    config_parser_4.read_config_buffer(user_buffer.data(), user_buffer.size());
+    // Values are only converted if they are numbers as a whole.
+    assert_value<int>("buffer_int", config_parser_4.get_int("buffer_int"), 5);
+    assert_value<std::string>("buffer_string", config_parser_4.get_string("buffer_string"), "c");
+
+
+    //////////
+    // 64 bit integers and doubles have their own types and all numbers are converted strictly.
+    //////////
+    NoSweatConfigFileParser config_parser_13{"default_config.cfg"};
+    const std::string wide_buffer{"int64 big = 9223372036854775807\nint64 small = -9223372036854775808\n"
+        "double precise = 0.1234567890123\ndouble tiny: 1e-300\nint64 too_big = 9223372036854775808\n"
+        "double with_garbage = 1.5x\nint not_an_int = 1.5\nfloat exponent = -2.5E3\nint plus = +3"};
+    config_parser_13.parse_default_config_buffer(wide_buffer.data(), wide_buffer.size());
+    assert_value<std::int64_t>("big", config_parser_13.get_int64("big"), INT64_MAX);
+    assert_value<std::int64_t>("small", config_parser_13.get_int64("small"), INT64_MIN);
+    assert_value<double>("precise", config_parser_13.get_double("precise"), 0.1234567890123);
+    assert_value<double>("tiny", config_parser_13.get_double("tiny"), 1e-300);
+    assert_value<float>("exponent", config_parser_13.get_float("exponent"), -2500);
+    assert_value<int>("plus", config_parser_13.get_int("plus"), 3);
+    assert_value<bool>("too_big", config_parser_13.get_handle<std::int64_t>("too_big").is_valid(), false);
+    assert_value<bool>("with_garbage", config_parser_13.get_handle<double>("with_garbage").is_valid(), false);
+    assert_value<bool>("not_an_int", config_parser_13.get_handle<int>("not_an_int").is_valid(), false);
+    // The wider types are distinct from int and float.
+    assert_value<int>("big", config_parser_13.get_int("big"), 0);
+    const std::string wide_override{"big = 42\ndouble precise = 2.5\ntiny = 1e400"};
+    config_parser_13.read_config_buffer(wide_override.data(), wide_override.size());
+    assert_value<std::int64_t>("big", config_parser_13.get_int64("big"), 42);
+    assert_value<double>("precise", config_parser_13.get_double("precise"), 2.5);
+    assert_value<double>("tiny", config_parser_13.get_double("tiny"), 1e-300);
+
+
+    //////////
+    // Applications can add boolean literals and type keywords.
+    //////////
+    NoSweatConfigFileParser config_parser_14{"default_config.cfg"};
+    assert_value<bool>("add literal", config_parser_14.add_boolean_literal("Enabled", true), true);
+    assert_value<bool>("add literal", config_parser_14.add_boolean_literal("disabled", false), true);
+    assert_value<bool>("add keyword", config_parser_14.add_type_keyword("integer", ValueType::Integer), true);
+    assert_value<bool>("add keyword", config_parser_14.add_type_keyword("long integer", ValueType::Integer64), false);
+    const std::string literal_buffer{"bool feature = ENABLED\nbool other_feature = disabled\ninteger count = 3\n"
+        "Integer wrong_case = 4\nbool still_true = Yes"};
+    config_parser_14.parse_default_config_buffer(literal_buffer.data(), literal_buffer.size());
+    assert_value<bool>("feature", config_parser_14.get_bool("feature"), true);
+    assert_value<bool>("other_feature", config_parser_14.get_bool("other_feature"), false);
+    assert_value<bool>("still_true", config_parser_14.get_bool("still_true"), true);
+    assert_value<int>("count", config_parser_14.get_int("count"), 3);
+    assert_value<int>("wrong_case", config_parser_14.get_int("wrong_case"), 0);
+    // Copies keep the additions, other parsers do not have them.
+    NoSweatConfigFileParser config_parser_15{config_parser_14};
+    config_parser_15.read_config_buffer("integer count = 5\nuse_accelerator = disabled", 44);
+    assert_value<int>("count", config_parser_15.get_int("count"), 5);
+    assert_value<bool>("use_accelerator", config_parser_15.get_bool("use_accelerator"), false);
+    config_parser_13.read_config_buffer("use_accelerator = disabled", 26);
+    assert_value<bool>("use_accelerator", config_parser_13.get_bool("use_accelerator"), true);
+
+
+    //////////
+    // Many keys of all types end up in the same value store.
+    //////////
+    std::string many_keys_buffer;
+    for (int i = 0; i < 5000; i++) {
+        many_keys_buffer += "int key " + std::to_string(i) + " = " + std::to_string(i) + "\n";
+        many_keys_buffer += "string string key " + std::to_string(i) + " = a string longer than sixteen characters " +
+            std::to_string(i) + "\n";
+    }
+    NoSweatConfigFileParser config_parser_5{"default_config.cfg"};
+    config_parser_5.parse_default_config_buffer(many_keys_buffer.data(), many_keys_buffer.size());
+    Handle<std::string> long_string_handle = config_parser_5.get_handle<std::string>("string key 4321");
+    const std::string long_string_override{"string string key 4321 = another string longer than sixteen characters"};
+    config_parser_5.read_config_buffer(long_string_override.data(), long_string_override.size());
+    bool all_keys_found = true;
+    for (int i = 0; i < 5000; i++)
+        all_keys_found = all_keys_found && config_parser_5.get_int("key " + std::to_string(i)) == i;
+    assert_value<bool>("all keys found", all_keys_found, true);
+    assert_value<std::string>("string key 4321", long_string_handle.get(),
+        "another string longer than sixteen characters");
+    assert_value<std::string>("string key 1234", config_parser_5.get_string("string key 1234"),
+        "a string longer than sixteen characters 1234");
+    // Copies do not share their values.
+    NoSweatConfigFileParser config_parser_6{config_parser_5};
+    config_parser_5.read_config_buffer("string string key 1234 = changed", 32);
+    assert_value<std::string>("string key 1234", config_parser_6.get_string("string key 1234"),
+        "a string longer than sixteen characters 1234");
+    assert_value<std::string>("string key 4321", config_parser_6.get_string("string key 4321"),
+        "another string longer than sixteen characters");
+    assert_value<std::string>("string key 1234", config_parser_5.get_string("string key 1234"), "changed");
+    assert_value<int>("max_number_of_users", config_parser_6.get_int("max_number_of_users"), 1);
+    // Strings longer than a storage block are kept as well as the shorter ones stored after them.
+    const std::string huge_string(100000, 'x');
+    const std::string huge_buffer{"string huge = " + huge_string + "\nstring after_huge = short but not inline"};
+    config_parser_6.parse_default_config_buffer(huge_buffer.data(), huge_buffer.size());
+    config_parser_6.read_config_buffer(huge_buffer.data() + 7, huge_buffer.size() - 7);
+    NoSweatConfigFileParser config_parser_17{config_parser_6};
+    assert_value<std::size_t>("huge", config_parser_17.get_string("huge").size(), huge_string.size());
+    assert_value<std::string>("after_huge", config_parser_17.get_string("after_huge"), "short but not inline");
+
+    //////////
+    // Reloading starts from the default values and replaces all user set values at once.
+    //////////
+    NoSweatConfigFileParser config_parser_7{"default_config.cfg", "config.cfg"};
+    config_parser_7.read_config_buffer("is_true = no", 12);
+    assert_value<bool>("is_true", config_parser_7.get_bool("is_true"), false);
+    config_parser_7.reload_config_file();
+    assert_value<bool>("is_true", config_parser_7.get_bool("is_true"), true);
+    assert_value<int>("max_number_of_users", config_parser_7.get_int("max_number_of_users"), 22);
+
+    // A view shows all values of one point in time.
+    Handle<std::string> username_handle_7 = config_parser_7.get_handle<std::string>("username");
+    {
+        ConfigView view{config_parser_7};
+        assert_value<std::string>("username", view.get(username_handle_7), "some_other_user");
+        assert_value<std::string>("username", view.get(username_handle), "");
+    }
+
+    // Readers on other threads always see complete values while the configuration is reloaded.
+    const std::string reload_buffers[] = {
+        "max_number_of_users = 100\nusername = a user name that is longer than sixteen characters",
+        "max_number_of_users = 200\nusername = another user name longer than sixteen characters"};
+    std::atomic<bool> stop_readers{false};
+    std::atomic<int> inconsistent_reads{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; i++) {
+        readers.emplace_back([&]() {
+            Handle<int> users = config_parser_7.get_handle<int>("max_number_of_users");
+            while (!stop_readers) {
+                ConfigView view{config_parser_7};
+                const int number_of_users = view.get(users);
+                const std::string username = view.get(username_handle_7);
+                if (!(number_of_users == 100 && username == "a user name that is longer than sixteen characters") &&
+                    !(number_of_users == 200 && username == "another user name longer than sixteen characters") &&
+                    !(number_of_users == 22 && username == "some_other_user"))
+                    inconsistent_reads++;
+                if (config_parser_7.get_string("username").empty())
+                    inconsistent_reads++;
+            }
+        });
+    }
+    for (int i = 0; i < 2000; i++)
+        config_parser_7.read_config_buffer(reload_buffers[i % 2].data(), reload_buffers[i % 2].size());
+    stop_readers = true;
+    for (std::thread& reader: readers)
+        reader.join();
+    assert_value<int>("inconsistent reads", inconsistent_reads, 0);
+    assert_value<int>("max_number_of_users", config_parser_7.get_int("max_number_of_users"), 200);
+
+    //////////
+    // All instruction sets of the line scanner find the same lines and assignment operators.
+    //////////
+    std::string scanner_buffer;
+    for (int i = 0; i < 200; i++)
+        scanner_buffer += std::string(i % 70, 'x') + (i % 3 ? "=" : "") + std::string(i % 5, ':') + "\n";
+    scanner_buffer += "no newline at the end: 1";
+    std::vector<SimdLevel> simd_levels{SimdLevel::Scalar};
+    if (detected_simd_level() >= SimdLevel::SSE2)
+        simd_levels.push_back(SimdLevel::SSE2);
+    if (detected_simd_level() >= SimdLevel::AVX2)
+        simd_levels.push_back(SimdLevel::AVX2);
+    for (SimdLevel simd_level: simd_levels) {
+        LineScanner scanner{scanner_buffer.data(), scanner_buffer.size(), simd_level};
+        const char* position = scanner_buffer.data();
+        const char* end = position + scanner_buffer.size();
+        StringRef line;
+        std::size_t assignment_index;
+        bool lines_match = true;
+        while (scanner.next(line, assignment_index)) {
+            const char* line_end = std::find(position, end, '\n');
+            std::string expected_line{position, line_end};
+            lines_match = lines_match && line == expected_line &&
+                assignment_index == expected_line.find_first_of(":=");
+            position = line_end + 1;
+        }
+        assert_value<bool>("LineScanner lines", lines_match && position == end + 1, true);
+    }
+
+    //////////
+    // Reading a configuration file again reports the keys whose values changed.
+    //////////
+    const std::string changed_file = "changed_config.cfg";
+    std::ofstream{changed_file} << "max_number_of_users = 2\nusername = someone\nis_true = no\n";
+    NoSweatConfigFileParser config_parser_9{"default_config.cfg", changed_file};
+    std::ofstream{changed_file} << "max_number_of_users = 3\nusername = someone\nis_true = no\n";
+    ChangeSet changes = config_parser_9.reload_config_file();
+    assert_value<std::size_t>("number of changes", changes.size(), 1);
+    assert_value<std::string>("changed key", changes.empty() ? "" : changes[0]->key, "max_number_of_users");
+    assert_value<int>("max_number_of_users", config_parser_9.get_int("max_number_of_users"), 3);
+    assert_value<std::size_t>("number of changes", config_parser_9.reload_config_file().size(), 0);
+    // Keys of removed lines return to their default value.
+    std::ofstream{changed_file} << "max_number_of_users = 3\nis_true = no\n";
+    changes = config_parser_9.reload_config_file();
+    assert_value<std::size_t>("number of changes", changes.size(), 1);
+    assert_value<std::string>("username", config_parser_9.get_string("username"), "some_user");
+    // A line that sets the same value again is no change.
+    std::ofstream{changed_file} << "max_number_of_users = 3\nis_true = no\nmax_number_of_users = 3\n";
+    assert_value<std::size_t>("number of changes", config_parser_9.read_config_file(changed_file).size(), 0);
+    std::remove(changed_file.c_str());
+
+    //////////
+    // Several files are loaded concurrently, with the same result as loading them one after the other.
+    //////////
+    const std::string fragment_directory = "test_conf.d";
+    ::mkdir(fragment_directory.c_str(), 0755);
+    std::ofstream{fragment_directory + "/20-host.conf"} << "max_number_of_users = 20\nusername = host\n";
+    std::ofstream{fragment_directory + "/10-site.cfg"} << "max_number_of_users = 10\nis_true = no\n";
+    std::ofstream{fragment_directory + "/30-ignored.txt"} << "max_number_of_users = 30\n";
+    std::vector<std::string> fragments = NoSweatConfigFileParser::config_directory_files(fragment_directory);
+    assert_value<std::size_t>("number of fragments", fragments.size(), 2);
+    std::ofstream{"extra_defaults.cfg"} << "int max_number_of_users = 5\nint extra_key = 6\n";
+    NoSweatConfigFileParser config_parser_12{"missing_default_config.cfg"};
+    config_parser_12.parse_default_config_files({"default_config.cfg", "extra_defaults.cfg"});
+    config_parser_12.read_config_files(fragments);
+    assert_value<int>("max_number_of_users", config_parser_12.get_int("max_number_of_users"), 20);
+    assert_value<int>("extra_key", config_parser_12.get_int("extra_key"), 6);
+    assert_value<std::string>("username", config_parser_12.get_string("username"), "host");
+    assert_value<bool>("is_true", config_parser_12.get_bool("is_true"), false);
+    for (const char* file: {"/20-host.conf", "/10-site.cfg", "/30-ignored.txt"})
+        std::remove((fragment_directory + file).c_str());
+    ::rmdir(fragment_directory.c_str());
+    std::remove("extra_defaults.cfg");
+
+    //////////
+    // Large buffers parsed in chunks on several threads give the same values as parsing them on one thread.
+    //////////
+    std::string chunked_defaults, chunked_overrides;
+    for (int i = 0; i < 60000; i++) {
+        chunked_defaults += "int chunked key " + std::to_string(i % 50000) + " = " + std::to_string(i) + "\n";
+        chunked_defaults += "string chunked string " + std::to_string(i) + " = a string longer than sixteen characters\n";
+        chunked_overrides += "chunked key " + std::to_string(i % 40000) + " = " + std::to_string(-i) + "\n";
+        chunked_overrides += "chunked string " + std::to_string(i % 30000) + " = another string " + std::to_string(i) + "\n";
+    }
+    NoSweatConfigFileParser serial_parser{"missing_default_config.cfg"};
+    NoSweatConfigFileParser chunked_parser{"missing_default_config.cfg"};
+    chunked_parser.set_parser_threads(4);
+    for (NoSweatConfigFileParser* parser: {&serial_parser, &chunked_parser}) {
+        parser->parse_default_config_buffer(chunked_defaults.data(), chunked_defaults.size());
+        parser->read_config_buffer(chunked_overrides.data(), chunked_overrides.size());
+    }
+    bool chunked_values_equal = true;
+    for (int i = 0; i < 60000; i++) {
+        const std::string key = "chunked key " + std::to_string(i);
+        const std::string string_key = "chunked string " + std::to_string(i);
+        chunked_values_equal = chunked_values_equal && serial_parser.get_int(key) == chunked_parser.get_int(key) &&
+            serial_parser.get_string(string_key) == chunked_parser.get_string(string_key);
+    }
+    assert_value<bool>("chunked values equal", chunked_values_equal, true);
+    assert_value<int>("chunked key 45000", chunked_parser.get_int("chunked key 45000"), 45000);
+    assert_value<int>("chunked key 12", chunked_parser.get_int("chunked key 12"), -40012);
+    assert_value<std::string>("chunked string 7", chunked_parser.get_string("chunked string 7"), "another string 30007");
+
+    //////////
+    // Keys of sections are distinct and can be set within the section or by their qualified name.
+    //////////
+    NoSweatConfigFileParser config_parser_18{"missing_default_config.cfg"};
+    const std::string section_defaults = "int port = 1\n"
+        "[server]\nint port = 80\nstring host = localhost\n"
+        "[database]\nint port = 5432\n"
+        "[ server.http ]\nint timeout = 30\nstring name = [not a header]\n";
+    config_parser_18.parse_default_config_buffer(section_defaults.data(), section_defaults.size());
+    assert_value<int>("port", config_parser_18.get_int("port"), 1);
+    assert_value<int>("server.port", config_parser_18.get_int("server.port"), 80);
+    assert_value<int>("database.port", config_parser_18.get_int("database.port"), 5432);
+    assert_value<std::string>("host", config_parser_18.get_string("host"), "localhost");
+    assert_value<std::string>("server.http.name", config_parser_18.get_string("server.http.name"), "[not a header]");
+    const std::string section_overrides = "[database]\nport = 6000\n"
+        "[server.http]\ntimeout = 60\n"
+        "[unknown]\nhost = example.org\n"
+        "[server]\ndatabase.port = 7000\n";
+    config_parser_18.read_config_buffer(section_overrides.data(), section_overrides.size());
+    assert_value<int>("port", config_parser_18.get_int("port"), 1);
+    assert_value<int>("server.port", config_parser_18.get_int("server.port"), 80);
+    assert_value<int>("database.port", config_parser_18.get_int("database.port"), 6000);
+    assert_value<int>("server.http.timeout", config_parser_18.get_int("server.http.timeout"), 60);
+    assert_value<std::string>("server.host", config_parser_18.get_string("server.host"), "example.org");
+    config_parser_18.read_config_buffer("database.port = 7000", 20);
+    assert_value<int>("database.port", config_parser_18.get_int("database.port"), 7000);
+
+    std::vector<std::string> section_keys;
+    for (const ConfigEntry* entry: config_parser_18.section_entries("server"))
+        section_keys.push_back(entry->qualified_key().str());
+    assert_value<std::size_t>("server keys", section_keys.size(), 4);
+    assert_value<std::string>("server key", section_keys.size() > 0 ? section_keys[0] : "", "server.host");
+    assert_value<std::string>("server key", section_keys.size() > 3 ? section_keys[3] : "", "server.port");
+    assert_value<std::size_t>("server.http keys", config_parser_18.keys_with_prefix("server.http.").size(), 2);
+    const std::vector<std::string> section_names = config_parser_18.sections();
+    assert_value<std::size_t>("number of sections", section_names.size(), 3);
+    assert_value<std::string>("section", section_names.empty() ? "" : section_names[0], "database");
+
+    // Sections reach across the chunks of large buffers.
+    std::string chunked_section_defaults, chunked_section_overrides;
+    for (int i = 0; i < 50000; i++) {
+        chunked_section_defaults += "[section " + std::to_string(i) + "]\n";
+        chunked_section_overrides += "[section " + std::to_string(i) + "]\n";
+        for (int j = 0; j < 3; j++)
+            chunked_section_defaults += "int key " + std::to_string(j) + " = " + std::to_string(i) + "\n";
+        for (int j = 0; j < 2; j++)
+            chunked_section_overrides += "key " + std::to_string(j) + " = " + std::to_string(-i) + "\n";
+    }
+    NoSweatConfigFileParser serial_section_parser{"missing_default_config.cfg"};
+    NoSweatConfigFileParser chunked_section_parser{"missing_default_config.cfg"};
+    chunked_section_parser.set_parser_threads(4);
+    for (NoSweatConfigFileParser* parser: {&serial_section_parser, &chunked_section_parser}) {
+        parser->parse_default_config_buffer(chunked_section_defaults.data(), chunked_section_defaults.size());
+        parser->read_config_buffer(chunked_section_overrides.data(), chunked_section_overrides.size());
+    }
+    bool section_values_equal = true;
+    for (int i = 0; i < 50000; i++) {
+        const std::string key = "section " + std::to_string(i) + ".key 1";
+        section_values_equal = section_values_equal &&
+            serial_section_parser.get_int(key) == chunked_section_parser.get_int(key);
+    }
+    assert_value<bool>("section values equal", section_values_equal, true);
+    assert_value<int>("section 49999.key 2", chunked_section_parser.get_int("section 49999.key 2"), 49999);
+    assert_value<int>("section 123.key 0", chunked_section_parser.get_int("section 123.key 0"), -123);
+
+    //////////
+    // Arrays of numbers are stored contiguously and can be continued on the following lines.
+    //////////
+    NoSweatConfigFileParser config_parser_19{"missing_default_config.cfg"};
+    const std::string array_defaults = "float[] taper = 0.1, 0.2, 0.3,\n"
+        "                0.4, 0.5\n"
+        "int[] sizes = 1,2,3,\n"
+        "int64[] big = 1234567890123456789, -9223372036854775808\n"
+        "double[] precise = 0.1234567890123456, 12345678.5e-3\n"
+        "int[] invalid = 1, x\n"
+        "string not_an_array = a, b,\n"
+        "ignored line\n";
+    config_parser_19.parse_default_config_buffer(array_defaults.data(), array_defaults.size());
+    const std::vector<float> taper = config_parser_19.get_float_array("taper");
+    assert_value<std::size_t>("taper size", taper.size(), 5);
+    assert_value<float>("taper[4]", taper.empty() ? 0 : taper.back(), 0.5);
+    assert_value<std::size_t>("sizes size", config_parser_19.get_int_array("sizes").size(), 3);
+    const std::vector<std::int64_t> big = config_parser_19.get_int64_array("big");
+    assert_value<std::int64_t>("big[0]", big.size() == 2 ? big[0] : 0, 1234567890123456789LL);
+    assert_value<std::int64_t>("big[1]", big.size() == 2 ? big[1] : 0, INT64_MIN);
+    const std::vector<double> precise = config_parser_19.get_double_array("precise");
+    assert_value<double>("precise[0]", precise.size() == 2 ? precise[0] : 0, 0.1234567890123456);
+    assert_value<double>("precise[1]", precise.size() == 2 ? precise[1] : 0, 12345.6785);
+    assert_value<std::size_t>("invalid size", config_parser_19.get_int_array("invalid").size(), 0);
+    assert_value<std::string>("not_an_array", config_parser_19.get_string("not_an_array"), "a, b,");
+    assert_value<std::size_t>("taper as int[]", config_parser_19.get_int_array("taper").size(), 0);
+
+    // Views return the elements without copying them.
+    Handle<std::vector<float>> taper_handle = config_parser_19.get_handle<std::vector<float>>("taper");
+    {
+        ConfigView view{config_parser_19};
+        ArrayRef<float> taper_elements = view.get(taper_handle);
+        assert_value<std::size_t>("taper elements", taper_elements.size(), 5);
+        assert_value<float>("taper[1]", taper_elements.size() > 1 ? taper_elements[1] : 0, 0.2);
+    }
+    const std::string array_overrides = "taper = 1, 2,\n"
+        "    # A comment ends the array.\n"
+        "    3\n"
+        "float[] sizes = 1\n"
+        "big = 1, two\n"
+        "int64[] big = 7,\n"
+        "  8,\n"
+        "  9,\n";
+    assert_value<std::size_t>("number of changes",
+        config_parser_19.read_config_buffer(array_overrides.data(), array_overrides.size()).size(), 2);
+    assert_value<std::size_t>("taper size", taper_handle.get().size(), 2);
+    assert_value<std::size_t>("sizes size", config_parser_19.get_int_array("sizes").size(), 3);
+    assert_value<std::size_t>("big size", config_parser_19.get_int64_array("big").size(), 3);
+    NoSweatConfigFileParser config_parser_20{config_parser_19};
+    assert_value<bool>("copied taper", config_parser_20.get_float_array("taper") == std::vector<float>{1, 2}, true);
+
+    // Only the statements that changed are parsed again when the file is read again.
+    const std::string array_file = "array_config.cfg";
+    std::ofstream{array_file} << "sizes = 4, 5,\n  6, 7\ntaper = 1\n";
+    config_parser_19.read_config_file(array_file);
+    assert_value<std::size_t>("sizes size", config_parser_19.get_int_array("sizes").size(), 4);
+    std::ofstream{array_file} << "sizes = 4, 5,\n  6, 8\ntaper = 1\n";
+    assert_value<std::size_t>("number of changes", config_parser_19.read_config_file(array_file).size(), 1);
+    assert_value<bool>("sizes", config_parser_19.get_int_array("sizes") == std::vector<int>{4, 5, 6, 8}, true);
+    std::remove(array_file.c_str());
+
+    // Arrays are never split between the chunks of large buffers.
+    std::string chunked_array_defaults, chunked_array_overrides;
+    for (int i = 0; i < 5000; i++) {
+        const std::string key = "array " + std::to_string(i);
+        chunked_array_defaults += "double[] " + key + " = 0.5,\n";
+        chunked_array_overrides += key + " = " + std::to_string(i) + ",\n";
+        for (int j = 0; j < 40; j++) {
+            chunked_array_defaults += "    " + std::to_string(j) + ".25, " + std::to_string(i) + ".5,\n";
+            chunked_array_overrides += "    " + std::to_string(j) + ", " + std::to_string(-i) + ",\n";
+        }
+        chunked_array_defaults += "    1e3\n";
+        chunked_array_overrides += "    0\n";
+    }
+    NoSweatConfigFileParser serial_array_parser{"missing_default_config.cfg"};
+    NoSweatConfigFileParser chunked_array_parser{"missing_default_config.cfg"};
+    chunked_array_parser.set_parser_threads(4);
+    for (NoSweatConfigFileParser* parser: {&serial_array_parser, &chunked_array_parser}) {
+        parser->parse_default_config_buffer(chunked_array_defaults.data(), chunked_array_defaults.size());
+        parser->read_config_buffer(chunked_array_overrides.data(), chunked_array_overrides.size() / 2);
+    }
+    bool array_values_equal = true;
+    for (int i = 0; i < 5000; i++) {
+        const std::string key = "array " + std::to_string(i);
+        array_values_equal = array_values_equal &&
+            serial_array_parser.get_double_array(key) == chunked_array_parser.get_double_array(key);
+    }
+    assert_value<bool>("array values equal", array_values_equal, true);
+    const std::vector<double> last_array = chunked_array_parser.get_double_array("array 4999");
+    assert_value<std::size_t>("array 4999 size", last_array.size(), 82);
+    assert_value<double>("array 4999[80]", last_array.size() == 82 ? last_array[80] : 0, 4999.5);
+    const std::vector<double> overridden_array = chunked_array_parser.get_double_array("array 7");
+    assert_value<double>("array 7[2]", overridden_array.size() == 82 ? overridden_array[2] : 0, -7);
+
+    //////////
+    // Schemas are filled in with the current values and can add keys.
+    //////////
+    NoSweatConfigFileParser config_parser_11{"default_config.cfg"};
+    config_parser_11.add_schema(TestSchema());
+    const std::string schema_buffer = "max_number_of_users = 3\nnot_in_default_config = 7";
+    config_parser_11.read_config_buffer(schema_buffer.data(), schema_buffer.size());
+    TestSchema schema;
+    config_parser_11.fill(schema);
+    assert_value<int>("max_number_of_users", schema.max_number_of_users, 3);
+    assert_value<float>("movement_speed", schema.movement_speed, 12.34);
+    assert_value<std::string>("username", schema.username, "some_user");
+    assert_value<bool>("use_accelerator", schema.use_accelerator, true);
+    assert_value<int>("not_in_default_config", schema.not_in_default_config, 7);
+    config_parser_11.read_config_buffer("not_in_default_config = 8", 25);
+    config_parser_11.fill(schema);
+    assert_value<int>("not_in_default_config", schema.not_in_default_config, 8);
+
+    //////////
+    // Parsed files can be loaded from a binary cache, which is rewritten once the files change.
+    //////////
+    const std::string cache_file = "config.cache";
+    const std::string cached_file = "cached_config.cfg";
+    std::remove(cache_file.c_str());
+    std::ofstream{cached_file} << "max_number_of_users = 7\nkey names can have spaces = a string that does not fit inline\n";
+    {
+        NoSweatConfigFileParser written{"default_config.cfg", cached_file, cache_file};
+        assert_value<bool>("cache written", std::ifstream{cache_file}.good(), true);
+    }
+    for (int i = 0; i < 2; i++) {
+        NoSweatConfigFileParser cached{"default_config.cfg", cached_file, cache_file};
+        assert_value<int>("max_number_of_users", cached.get_int("max_number_of_users"), 7);
+        assert_value<float>("movement_speed", cached.get_float("movement_speed"), 12.34);
+        assert_value<std::string>("key names can have spaces", cached.get_string("key names can have spaces"),
+            "a string that does not fit inline");
+        assert_value<bool>("is_false", cached.get_bool("is_false"), false);
+        assert_value<bool>("taper", cached.get_float_array("taper") == std::vector<float>{0.1f, 0.2f, 0.3f}, true);
+        // Cached values are reloaded like parsed ones.
+        std::ofstream{cached_file} << "max_number_of_users = 8\nkey names can have spaces = a string that does not fit inline\n";
+        assert_value<std::size_t>("number of changes", cached.reload_config_file().size(), 1);
+        NoSweatConfigFileParser copy{cached};
+        std::ofstream{cached_file} << "max_number_of_users = 7\nkey names can have spaces = a string that does not fit inline\n";
+        assert_value<int>("max_number_of_users", copy.get_int("max_number_of_users"), 8);
+    }
+    std::ofstream{cached_file} << "max_number_of_users = 9\n";
+    assert_value<int>("max_number_of_users",
+        NoSweatConfigFileParser("default_config.cfg", cached_file, cache_file).get_int("max_number_of_users"), 9);
+    std::remove(cached_file.c_str());
+    std::remove(cache_file.c_str());
+
+    //////////
+    // Subscribers are notified of changed values only.
+    //////////
+    NoSweatConfigFileParser config_parser_10{"default_config.cfg"};
+    std::vector<std::string> notifications;
+    config_parser_10.subscribe<int>("max_number_of_users", [&](StringRef key, int old_value, int new_value) {
+        notifications.push_back(key.str() + ":" + std::to_string(old_value) + "->" + std::to_string(new_value));
+    });
+    const std::size_t prefix_subscription = config_parser_10.subscribe_prefix<bool>("is_",
+        [&](StringRef key, bool old_value, bool new_value) {
+            notifications.push_back(key.str() + ":" + (old_value ? "true" : "false") + "->" +
+                                    (new_value ? "true" : "false"));
+        });
+    const std::string subscribed_buffer = "max_number_of_users = 5\nis_true = no\nis_false = no\nuse_accelerator = no";
+    config_parser_10.read_config_buffer(subscribed_buffer.data(), subscribed_buffer.size());
+    assert_value<std::size_t>("number of notifications", notifications.size(), 2);
+    assert_value<std::string>("notification", notifications.size() > 1 ? notifications[0] + " " + notifications[1] : "",
+        "max_number_of_users:1->5 is_true:true->false");
+    config_parser_10.unsubscribe(prefix_subscription);
+    notifications.clear();
+    config_parser_10.read_config_buffer("max_number_of_users = 5\nis_true = yes", 37);
+    assert_value<std::size_t>("number of notifications", notifications.size(), 0);
+
+    //////////
+    // Instrumentation counts reads and misses and times the parse phases (if compiled in).
+    //////////
+    NoSweatConfigFileParser config_parser_16{"default_config.cfg"};
+#ifdef NOSWEAT_INSTRUMENTATION
+    Handle<int> instrumented_handle = config_parser_16.get_handle<int>("max_number_of_users");
+    config_parser_16.get_int("max_number_of_users");
+    instrumented_handle.get();
+    ConfigView{config_parser_16}.get(instrumented_handle);
+    config_parser_16.get_string("username");
+    config_parser_16.get_int("username");
+    config_parser_16.get_int("username");
+    const InstrumentationStats stats = config_parser_16.instrumentation_stats();
+    assert_value<bool>("instrumentation enabled", stats.enabled, true);
+    assert_value<std::size_t>("number of read keys", stats.reads.size(), 2);
+    assert_value<std::string>("most read key", stats.reads.empty() ? "" : stats.reads[0].key, "max_number_of_users");
+    assert_value<std::uint64_t>("max_number_of_users reads", stats.reads.empty() ? 0 : stats.reads[0].count, 3);
+    assert_value<std::size_t>("number of misses", stats.misses.size(), 1);
+    assert_value<std::uint64_t>("username misses", stats.misses.empty() ? 0 : stats.misses[0].count, 2);
+    assert_value<bool>("miss type", !stats.misses.empty() && stats.misses[0].type == ValueType::Integer, true);
+    assert_value<bool>("convert phase timed", stats.phase_nanoseconds[static_cast<int>(Phase::Convert)] > 0, true);
+#else
+    assert_value<bool>("instrumentation enabled", config_parser_16.instrumentation_stats().enabled, false);
+#endif
+
+    //////////
+    // Streams yield the lines of a pipe one at a time, also with a buffer smaller than a line.
+    //////////
+    const std::string streamed_config = "# A comment = no line\n"
+        "int max_number_of_users = 5\n"
+        "\n"
+        "username: a rather long user name\n"
+        "no assignment\n"
+        "integer timeout = 30\n"
+        "last_line = has no newline";
+    int pipe_fds[2];
+    assert_value<int>("pipe", pipe(pipe_fds), 0);
+    std::thread pipe_writer{[&]() {
+        // Written in small pieces, so the stream has to wait for more.
+        for (std::size_t i = 0; i < streamed_config.size(); i += 7)
+            write(pipe_fds[1], streamed_config.data() + i, std::min<std::size_t>(7, streamed_config.size() - i));
+        close(pipe_fds[1]);
+    }};
+    ConfigStream pipe_stream{pipe_fds[0], 8};
+    std::vector<std::string> events;
+    ConfigEvent event;
+    while (pipe_stream.next(event))
+        events.push_back(std::to_string(event.line_number) + " " + value_type_name(event.type) + " " +
+                         event.key.str() + "=" + event.value.str());
+    pipe_writer.join();
+    close(pipe_fds[0]);
+    assert_value<bool>("stream error", pipe_stream.has_error(), false);
+    assert_value<std::size_t>("number of streamed lines", events.size(), 4);
+    assert_value<std::string>("streamed line", events.size() > 0 ? events[0] : "", "2 int max_number_of_users=5");
+    assert_value<std::string>("streamed line", events.size() > 1 ? events[1] : "",
+                              "4 unknown username=a rather long user name");
+    assert_value<std::string>("streamed line", events.size() > 2 ? events[2] : "", "6 unknown integer timeout=30");
+    assert_value<std::string>("streamed line", events.size() > 3 ? events[3] : "", "7 unknown last_line=has no newline");
+
+    // Type keywords of a parser, reading from a std::istream and stopping early.
+    config_parser_16.add_type_keyword("integer", ValueType::Integer);
+    std::istringstream streamed_input{streamed_config};
+    ConfigStream istream_stream{streamed_input};
+    istream_stream.use_type_keywords(config_parser_16);
+    std::size_t timeout_line = 0;
+    while (istream_stream.next(event)) {
+        if (event.key == StringRef("timeout") && event.type == ValueType::Integer) {
+            timeout_line = event.line_number;
+            break;
+        }
+    }
+    assert_value<std::size_t>("timeout line", timeout_line, 6);
+    ConfigStream buffer_stream{streamed_config.data(), streamed_config.size()};
+    std::size_t buffer_lines = 0;
+    while (buffer_stream.next(event))
+        buffer_lines++;
+    assert_value<std::size_t>("number of streamed lines", buffer_lines, 4);
+    const std::string streamed_sections = "int port = 1\n[server]\nint port = 80\n";
+    ConfigStream section_stream{streamed_sections.data(), streamed_sections.size()};
+    std::string streamed_keys;
+    while (section_stream.next(event))
+        streamed_keys += "[" + event.section.str() + "]" + event.key.str() + " ";
+    assert_value<std::string>("streamed sections", streamed_keys, "[]port [server]port ");
+    const std::string streamed_comments = "# int a = 1\n; int b = 2\n  ; c = 3\nint d = 4\n";
+    ConfigStream comment_stream{streamed_comments.data(), streamed_comments.size()};
+    std::string uncommented_keys;
+    while (comment_stream.next(event))
+        uncommented_keys += event.key.str() + " ";
+    assert_value<std::string>("streamed comments", uncommented_keys, "d ");
+    // Arrays continued on the following lines are yielded as one line, also across refills of the buffer.
+    std::istringstream streamed_array{"float[] taper = 0.1, 0.2,\n  0.3,\n\t0.4\nint after = 1,\n\nint last = 2,"};
+    ConfigStream array_stream{streamed_array, 8};
+    std::vector<std::string> array_events;
+    while (array_stream.next(event))
+        array_events.push_back(std::to_string(event.line_number) + " " + event.key.str() + "=" + event.value.str());
+    assert_value<std::size_t>("number of streamed arrays", array_events.size(), 3);
+    assert_value<std::string>("streamed array", array_events.size() > 0 ? array_events[0] : "",
+                              "1 taper=0.1, 0.2,\n  0.3,\n\t0.4");
+    assert_value<std::string>("streamed after array", array_events.size() > 1 ? array_events[1] : "", "4 after=1,");
+    assert_value<std::string>("streamed last array", array_events.size() > 2 ? array_events[2] : "", "6 last=2,");
+
+    //////////
+    // Watched configuration files are reloaded after they change, also when replaced by renaming.
+    //////////
+    for (bool use_inotify: {true, false}) {
+        const std::string watched_file = "watched_config.cfg";
+        std::ofstream{watched_file} << "max_number_of_users = 2\n";
+        NoSweatConfigFileParser config_parser_8{"default_config.cfg", watched_file};
+        ConfigFileWatcher watcher{use_inotify};
+        watcher.set_debounce_interval(std::chrono::milliseconds(10));
+        watcher.set_poll_interval(std::chrono::milliseconds(10));
+        const std::size_t watch_id = watcher.watch(config_parser_8);
+
+        // Wait until the change is visible, but at most two seconds.
+        auto wait_for_users = [&](int number_of_users) {
+            for (int i = 0; i < 200 && config_parser_8.get_int("max_number_of_users") != number_of_users; i++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return config_parser_8.get_int("max_number_of_users");
+        };
+        // Make sure the modification time changes for polling.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::ofstream{watched_file} << "max_number_of_users = 3\n";
+        assert_value<int>("max_number_of_users", wait_for_users(3), 3);
+        std::ofstream{watched_file + ".new"} << "max_number_of_users = 4\n";
+        std::rename((watched_file + ".new").c_str(), watched_file.c_str());
+        assert_value<int>("max_number_of_users", wait_for_users(4), 4);
+
+        // Files in a directory inotify cannot watch yet are polled.
+        const std::string new_directory = "watched_directory";
+        const std::string new_directory_file = new_directory + "/watched_config.cfg";
+        std::atomic<int> new_directory_changes{0};
+        const std::size_t new_directory_watch_id = watcher.watch(new_directory_file,
+                                                                 [&]() { new_directory_changes++; });
+        ::mkdir(new_directory.c_str(), 0755);
+        std::ofstream{new_directory_file} << "max_number_of_users = 5\n";
+        for (int i = 0; i < 200 && !new_directory_changes; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        assert_value<bool>("file in new directory", new_directory_changes > 0, true);
+
+        watcher.unwatch(new_directory_watch_id);
+        watcher.unwatch(watch_id);
+        std::remove(new_directory_file.c_str());
+        ::rmdir(new_directory.c_str());
+        std::remove(watched_file.c_str());
+    }
+
+    //////////
+    // Command line arguments and environment variables override the configuration files.
+    //////////
+    {
+        NoSweatConfigFileParser config_parser_22{"default_config.cfg", "config.cfg"};
+        ::setenv("NOSWEAT_TEST_max_number_of_users", "7", 1);
+        ::setenv("NOSWEAT_TEST_USE_ACCELERATOR", "yes", 1);
+        ::setenv("NOSWEAT_TEST_MOVEMENT_SPEED", "fast", 1);
+        ::setenv("NOSWEAT_TEST_ARRAYS__TAPER", "1, 2", 1);
+        const char* argv[] = {"program", "--set", "username=override_user", "--verbose",
+                              "--set=int max_number_of_users = 8", "--set", "float username=1.5", "--set"};
+        const ChangeSet changes = config_parser_22.apply_overrides(8, argv, "NOSWEAT_TEST_");
+        assert_value<std::size_t>("override changes", changes.size(), 4);
+        assert_value<int>("overridden max_number_of_users", config_parser_22.get_int("max_number_of_users"), 8);
+        assert_value<bool>("overridden use_accelerator", config_parser_22.get_bool("use_accelerator"), true);
+        assert_value<float>("invalid override", config_parser_22.get_float("movement_speed"), 123.4);
+        assert_value<std::string>("overridden username", config_parser_22.get_string("username"), "override_user");
+        assert_value<std::size_t>("overridden taper", config_parser_22.get_float_array("arrays.taper").size(), 2);
+
+        // Overrides stay on top of everything read afterwards, also in copies.
+        config_parser_22.reload_config_file();
+        assert_value<int>("reloaded override", config_parser_22.get_int("max_number_of_users"), 8);
+        const std::string more_users = "max_number_of_users = 3\nmovement_speed = 1.5\n";
+        config_parser_22.read_config_buffer(more_users.data(), more_users.size());
+        assert_value<int>("override after read", config_parser_22.get_int("max_number_of_users"), 8);
+        assert_value<float>("read after override", config_parser_22.get_float("movement_speed"), 1.5);
+        NoSweatConfigFileParser config_parser_23{config_parser_22};
+        config_parser_23.reload_config_file();
+        assert_value<std::string>("copied override", config_parser_23.get_string("username"), "override_user");
+        assert_value<bool>("no cache with overrides", config_parser_22.write_config_cache("override.cache"), false);
+
+        // Empty values are ignored like lines without a value, so the emitted configuration parses again.
+        ::setenv("NOSWEAT_TEST_EMPTY_username", "", 1);
+        NoSweatConfigFileParser config_parser_28{"default_config.cfg", "config.cfg"};
+        const std::string username = config_parser_28.get_string("username");
+        const char* empty_argv[] = {"program", "--set", "username="};
+        assert_value<std::size_t>("empty overrides",
+                                  config_parser_28.apply_overrides(3, empty_argv, "NOSWEAT_TEST_EMPTY_").size(), 0);
+        assert_value<std::string>("empty override", config_parser_28.get_string("username"), username);
+        for (const char* name: {"NOSWEAT_TEST_max_number_of_users", "NOSWEAT_TEST_USE_ACCELERATOR",
+                                "NOSWEAT_TEST_MOVEMENT_SPEED", "NOSWEAT_TEST_ARRAYS__TAPER",
+                                "NOSWEAT_TEST_EMPTY_username"})
+            ::unsetenv(name);
+    }
+
+    //////////
+    // The emitted configuration parses back to the same values, also with only the changed ones.
+    //////////
+    {
+        NoSweatConfigFileParser config_parser_24{"default_config.cfg", "config.cfg"};
+        const std::size_t emitted_size = config_parser_24.emit_configuration(nullptr, 0);
+        std::string emitted(emitted_size, '\0');
+        assert_value<std::size_t>("emitted size", config_parser_24.emit_configuration(&emitted[0], emitted.size()),
+                                  emitted_size);
+        std::ostringstream json;
+        config_parser_24.emit_configuration(json, EmitFormat::Json);
+
+        NoSweatConfigFileParser config_parser_25{"missing_default_config.cfg"};
+        config_parser_25.parse_default_config_buffer(emitted.data(), emitted.size());
+        std::ostringstream reparsed_json;
+        config_parser_25.emit_configuration(reparsed_json, EmitFormat::Json);
+        assert_value<bool>("round trip", json.str() == reparsed_json.str() && !emitted.empty(), true);
+        assert_value<float>("round trip float", config_parser_25.get_float("movement_speed"), 123.4);
+        assert_value<bool>("round trip array", config_parser_25.get_float_array("arrays.taper") ==
+                           config_parser_24.get_float_array("arrays.taper"), true);
+
+        const std::size_t changed_size = config_parser_24.emit_configuration(nullptr, 0, EmitFormat::Config, true);
+        std::string changed(changed_size, '\0');
+        config_parser_24.emit_configuration(&changed[0], changed.size(), EmitFormat::Config, true);
+        NoSweatConfigFileParser config_parser_26{"default_config.cfg"};
+        config_parser_26.read_config_buffer(changed.data(), changed.size());
+        std::ostringstream changed_json;
+        config_parser_26.emit_configuration(changed_json, EmitFormat::Json);
+        assert_value<bool>("changed round trip", json.str() == changed_json.str() && changed_size < emitted_size,
+                           true);
+
+        // Strings are escaped in JSON, and file descriptors get the same text as buffers.
+        const std::string quoted_user = "username = a \"b\" \\ c\n";
+        config_parser_26.read_config_buffer(quoted_user.data(), quoted_user.size());
+        std::ostringstream quoted_json;
+        config_parser_26.emit_configuration(quoted_json, EmitFormat::Json, true);
+        assert_value<bool>("escaped string",
+                           quoted_json.str().find("username\": \"a \\\"b\\\" \\\\ c\",\n") != std::string::npos, true);
+        const int emitted_fd = ::open("emitted_config.cfg", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        assert_value<bool>("emit to fd", config_parser_24.emit_configuration(emitted_fd), true);
+        ::close(emitted_fd);
+        std::ifstream emitted_file{"emitted_config.cfg"};
+        const std::string emitted_file_contents{std::istreambuf_iterator<char>(emitted_file),
+                                                std::istreambuf_iterator<char>()};
+        assert_value<bool>("emitted file", emitted_file_contents == emitted, true);
+        std::remove("emitted_config.cfg");
+    }
+
+    //////////
+    // Values are published while an emitted configuration is still written to a full pipe.
+    //////////
+    {
+        std::string many_keys;
+        for (int i = 0; i < 10000; i++)
+            many_keys += "int key_" + std::to_string(i) + " = " + std::to_string(i) + "\n";
+        NoSweatConfigFileParser config_parser_27{"missing_default_config.cfg"};
+        config_parser_27.parse_default_config_buffer(many_keys.data(), many_keys.size());
+        const std::size_t emitted_size = config_parser_27.emit_configuration(nullptr, 0);
+        int emit_pipe[2];
+        assert_value<int>("emit pipe", ::pipe(emit_pipe), 0);
+        std::thread emit_thread{[&]() {
+            config_parser_27.emit_configuration(emit_pipe[1]);
+            ::close(emit_pipe[1]);
+        }};
+        // The text is larger than the pipe, so the emit blocks once the first byte has been written.
+        std::string piped(1, '\0');
+        assert_value<bool>("emit started", ::read(emit_pipe[0], &piped[0], 1) == 1, true);
+        std::atomic<bool> is_published{false};
+        std::thread read_thread{[&]() {
+            const std::string changed_key = "key_0 = -1\n";
+            config_parser_27.read_config_buffer(changed_key.data(), changed_key.size());
+            is_published = true;
+        }};
+        for (int i = 0; i < 200 && !is_published; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        assert_value<bool>("published while emitting", is_published, true);
+        char buffer[4096];
+        for (ssize_t size; (size = ::read(emit_pipe[0], buffer, sizeof(buffer))) > 0;)
+            piped.append(buffer, static_cast<std::size_t>(size));
+        ::close(emit_pipe[0]);
+        emit_thread.join();
+        read_thread.join();
+        assert_value<std::size_t>("emitted while publishing", piped.size(), emitted_size);
+        assert_value<int>("published value", config_parser_27.get_int("key_0"), -1);
+    }
+
+    //////////
+    // Published values are read by other processes, also while they are published again.
+    //////////
+    {
+        const std::string shared_name = "/nosweat_test_" + std::to_string(::getpid());
+        NoSweatConfigFileParser config_parser_21{"default_config.cfg", "config.cfg"};
+        SharedConfigPublisher publisher{shared_name, config_parser_21};
+        SharedConfigReader reader{shared_name};
+        assert_value<bool>("reader is open", publisher.is_open() && reader.is_open(), true);
+        assert_value<int>("shared max_number_of_users", reader.get_int("max_number_of_users"),
+                          config_parser_21.get_int("max_number_of_users"));
+        assert_value<int>("shared qualified key", reader.get_int("basic config group.max_number_of_users"),
+                          config_parser_21.get_int("max_number_of_users"));
+        assert_value<std::string>("shared username", reader.get_string("username"),
+                                  config_parser_21.get_string("username"));
+        assert_value<float>("shared movement_speed", reader.get_float("movement_speed"),
+                            config_parser_21.get_float("movement_speed"));
+        assert_value<bool>("shared taper", reader.get_float_array("taper") == config_parser_21.get_float_array("taper"),
+                           true);
+        assert_value<int>("shared username as int", reader.get_int("username"), 0);
+        assert_value<std::string>("shared unknown key", reader.get_string("not_a_key"), "");
+        assert_value<std::uint64_t>("shared version", reader.version(), 0);
+        assert_value<bool>("missing object", SharedConfigReader{shared_name + "_missing"}.is_open(), false);
+        assert_value<bool>("publish other keys", publisher.publish(config_parser_19), false);
+
+        // A worker attaches on its own and only ever sees complete strings.
+        const int publications = 2000;
+        const std::string short_user = "username = " + std::string(10, 'a') + "\n";
+        const std::string long_user = "username = " + std::string(300, 'b') + "\n";
+        const pid_t worker = ::fork();
+        if (worker == 0) {
+            SharedConfigReader worker_reader{shared_name};
+            bool is_consistent = worker_reader.is_open();
+            while (is_consistent && worker_reader.version() < std::uint64_t(publications)) {
+                const std::string username = worker_reader.get_string("username");
+                is_consistent = username == config_parser_21.get_string("username") ||
+                    username == std::string(10, 'a') || username == std::string(300, 'b');
+            }
+            ::_exit(is_consistent && worker_reader.get_string("username") == std::string(300, 'b') ? 0 : 1);
+        }
+        bool is_published = true;
+        for (int i = 0; i < publications; i++) {
+            const std::string& user = i % 2 ? long_user : short_user;
+            config_parser_21.read_config_buffer(user.data(), user.size());
+            is_published = publisher.publish(config_parser_21) && is_published;
+        }
+        int worker_status = -1;
+        ::waitpid(worker, &worker_status, 0);
+        assert_value<bool>("published", is_published, true);
+        assert_value<int>("worker status", worker_status, 0);
+        assert_value<std::uint64_t>("shared version", reader.version(), publications);
+        assert_value<std::size_t>("shared username", reader.get_string("username").size(), 300);
+
+        // A publisher that died while publishing leaves the sequence number odd; readers give up after a while.
+        const int shared_fd = ::shm_open(shared_name.c_str(), O_RDWR, 0);
+        void* shared_header = ::mmap(nullptr, sizeof(SharedConfigRegion::Header), PROT_READ | PROT_WRITE, MAP_SHARED,
+                                     shared_fd, 0);
+        ::close(shared_fd);
+        std::atomic<std::uint64_t>& sequence = static_cast<SharedConfigRegion::Header*>(shared_header)->sequence;
+        sequence++;
+        const std::chrono::steady_clock::time_point read_start = std::chrono::steady_clock::now();
+        assert_value<std::string>("username while publishing", reader.get_string("username"), "");
+        assert_value<bool>("read timeout",
+                           std::chrono::steady_clock::now() - read_start < 2 * SharedConfigRegion::read_timeout(), true);
+        sequence--;
+        ::munmap(shared_header, sizeof(SharedConfigRegion::Header));
+
+        // Readers attached before keep the last values once the name is removed.
+        assert_value<bool>("unlink", publisher.unlink(), true);
+        assert_value<bool>("reattach", SharedConfigReader{shared_name}.is_open(), false);
+        assert_value<std::size_t>("unlinked username", reader.get_string("username").size(), 300);
+    }
+
+    //////////
+    // Objects created while all strings are empty still have room for strings published later.
+    //////////
+    {
+        const std::string shared_name = "/nosweat_test_empty_" + std::to_string(::getpid());
+        NoSweatConfigFileParser config_parser_29{"missing_default_config.cfg"};
+        config_parser_29.add_schema(TestSchema());
+        SharedConfigPublisher publisher{shared_name, config_parser_29};
+        SharedConfigReader reader{shared_name};
+        const std::string user = "username = hello world\n";
+        config_parser_29.read_config_buffer(user.data(), user.size());
+        assert_value<bool>("publish after empty strings", publisher.publish(config_parser_29), true);
+        assert_value<std::string>("shared string after empty strings", reader.get_string("username"), "hello world");
+        publisher.unlink();
+    }
+
+
+
     // Print some kind of "error report".
     std::cout << std::endl;
     std::cout << "Passed " << tests_passed << " of " << total_tests << " \"tests\" (asserts)." << std::endl;
+    return tests_passed == total_tests ? 0 : 1;
 }